@@ -0,0 +1,102 @@
+/*
+ * Allocation accounting.  See alloc.h.
+ */
+
+#include <malloc.h>
+
+#include "alloc.h"
+
+int alloc_accounting = 0;
+
+struct alloc_stats {
+    unsigned long count;    /* Allocations. */
+    unsigned long bytes;    /* Bytes allocated. */
+    long live;              /* Bytes allocated and not freed. */
+    long peak;              /* Highest live bytes. */
+};
+
+static struct alloc_stats stats[ALLOC_CATEGORIES];
+static struct alloc_stats total;
+
+static const char *category_names[ALLOC_CATEGORIES] = {
+    [ALLOC_FRUITS] = "fruits",
+    [ALLOC_VARIETIES] = "varieties",
+    [ALLOC_STRINGS] = "strings",
+    [ALLOC_INTERN] = "intern",
+    [ALLOC_NAMES] = "names",
+    [ALLOC_OTHER] = "other",
+};
+
+static void
+update_peak(struct alloc_stats *s, long live)
+{
+    long peak = __atomic_load_n(&s->peak, __ATOMIC_RELAXED);
+
+    while (live > peak &&
+           !__atomic_compare_exchange_n(&s->peak, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/* Count the block p, just allocated in a category, if accounting is on. */
+void
+alloc_count(enum alloc_category category, void *p)
+{
+    struct alloc_stats *s = &stats[category];
+    long size;
+
+    if (!alloc_accounting || !p) {
+        return;
+    }
+    size = malloc_usable_size(p);
+    __atomic_add_fetch(&s->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->bytes, size, __ATOMIC_RELAXED);
+    update_peak(s, __atomic_add_fetch(&s->live, size, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&total.count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&total.bytes, size, __ATOMIC_RELAXED);
+    update_peak(&total, __atomic_add_fetch(&total.live, size, __ATOMIC_RELAXED));
+}
+
+/* Uncount the block p of a category, about to be freed, if accounting is on. */
+void
+alloc_uncount(enum alloc_category category, void *p)
+{
+    long size;
+
+    if (!alloc_accounting || !p) {
+        return;
+    }
+    size = malloc_usable_size(p);
+    __atomic_sub_fetch(&stats[category].live, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&total.live, size, __ATOMIC_RELAXED);
+}
+
+static void
+print_stats(FILE *fp, const char *name, const struct alloc_stats *s)
+{
+    fprintf(fp, "%-14s %12lu %14lu %14ld %14ld\n", name, s->count, s->bytes, s->live, s->peak);
+}
+
+/*
+ * Print the allocation statistics.  If the number of records in memory is
+ * given, also print the memory used per record.
+ */
+void
+alloc_report(FILE *fp, size_t nfruits, size_t nvarieties)
+{
+    long records = 0;
+
+    fprintf(fp, "%-14s %12s %14s %14s %14s\n", "allocations", "count", "bytes", "live-bytes", "peak-bytes");
+    for (int i = 0; i < ALLOC_CATEGORIES; i++) {
+        print_stats(fp, category_names[i], &stats[i]);
+    }
+    print_stats(fp, "total", &total);
+    if (nfruits > 0) {
+        for (int i = ALLOC_FRUITS; i <= ALLOC_NAMES; i++) {
+            records += stats[i].live;
+        }
+        fprintf(fp, "catalog: %ld bytes live for %zu fruits and %zu varieties, %.1f bytes per fruit\n",
+                records, nfruits, nvarieties, (double)records / nfruits);
+        fprintf(fp, "peak: %ld bytes, %.1f bytes per fruit\n",
+                total.peak, (double)total.peak / nfruits);
+    }
+}
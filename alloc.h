@@ -0,0 +1,37 @@
+/*
+ * Allocation accounting.
+ *
+ * The bail_*_as() helpers in fruit.c count the memory they allocate and free
+ * in a category when alloc_accounting is set: the calls, the bytes
+ * allocated, and the live and peak bytes.  Sizes are taken from
+ * malloc_usable_size().  Set alloc_accounting before the first allocation,
+ * or a block allocated before it and freed after is uncounted without ever
+ * having been counted.
+ *
+ * The allocations of libyaml and the C library are not seen here; preload
+ * allocstat.so to count those.
+ */
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+enum alloc_category {
+    ALLOC_FRUITS,       /* fruit records */
+    ALLOC_VARIETIES,    /* variety records */
+    ALLOC_STRINGS,      /* string storage */
+    ALLOC_INTERN,       /* string interning tables */
+    ALLOC_NAMES,        /* name index tables */
+    ALLOC_OTHER,        /* other bail_alloc() memory */
+    ALLOC_CATEGORIES
+};
+
+extern int alloc_accounting;
+
+void alloc_count(enum alloc_category category, void *p);
+void alloc_uncount(enum alloc_category category, void *p);
+void alloc_report(FILE *fp, size_t nfruits, size_t nvarieties);
+
+#endif
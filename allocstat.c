@@ -0,0 +1,79 @@
+/*
+ * Allocation counter for benchmarks.
+ *
+ * Loaded with LD_PRELOAD, this counts the calls to the malloc family and the
+ * bytes requested, including those made inside libyaml, and writes the
+ * totals to the file named by ALLOCSTAT_FILE when the program exits:
+ *
+ *    $ LD_PRELOAD=./allocstat.so ALLOCSTAT_FILE=/dev/stderr ./parse fruit.yaml
+ *
+ * The real allocator is reached through the glibc __libc_* entry points, so
+ * no dlsym() call is needed before the first allocation.
+ */
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static unsigned long allocations;
+static unsigned long allocated;
+
+static void
+count(size_t size)
+{
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocated, size, __ATOMIC_RELAXED);
+}
+
+void *
+malloc(size_t size)
+{
+    count(size);
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+    count(n * size);
+    return __libc_calloc(n, size);
+}
+
+void *
+realloc(void *p, size_t size)
+{
+    count(size);
+    return __libc_realloc(p, size);
+}
+
+int
+posix_memalign(void **p, size_t alignment, size_t size)
+{
+    count(size);
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+
+void *
+aligned_alloc(size_t alignment, size_t size)
+{
+    count(size);
+    return __libc_memalign(alignment, size);
+}
+
+static void __attribute__((destructor))
+report(void)
+{
+    const char *path = getenv("ALLOCSTAT_FILE");
+    FILE *fp;
+
+    if (path && (fp = fopen(path, "w"))) {
+        fprintf(fp, "allocations %lu\nallocated-bytes %lu\n", allocations, allocated);
+        fclose(fp);
+    }
+}
@@ -0,0 +1,150 @@
+/*
+ * Arena (bump) allocator.
+ *
+ * The parser creates a lot of small strings which all live exactly as long as
+ * the document they came from.  Instead of allocating and freeing each one,
+ * they are packed into large blocks which are released together.
+ *
+ * Blocks are kept in a list.  Resetting the arena rewinds to the first block
+ * without freeing anything, so a long running program which reloads its data
+ * repeatedly reaches a steady state where it does not call malloc at all.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "fruit.h"
+
+#define ARENA_ALIGN (_Alignof(max_align_t))
+
+void
+arena_init(struct arena *a, size_t block_size)
+{
+    memset(a, 0, sizeof(*a));
+    a->block_size = block_size ? block_size : ARENA_BLOCK_SIZE;
+}
+
+/* Allocate a new block with room for at least size bytes after current. */
+static struct arena_block *
+arena_grow(struct arena *a, size_t size)
+{
+    struct arena_block *b;
+
+    if (size < a->block_size) {
+        size = a->block_size;
+    }
+    b = bail_alloc_as(ALLOC_STRINGS, sizeof(*b) + size);
+    b->size = size;
+    b->used = 0;
+    if (!a->current) {
+        a->head = b;
+    } else {
+        b->next = a->current->next;
+        a->current->next = b;
+    }
+    return b;
+}
+
+/* Allocate size bytes from the arena with the given alignment. */
+static void *
+arena_alloc_aligned(struct arena *a, size_t size, size_t align)
+{
+    struct arena_block *b = a->current;
+    size_t offset;
+
+    while (b) {
+        offset = (b->used + align - 1) & ~(align - 1);
+        if (offset + size <= b->size) {
+            b->used = offset + size;
+            return b->data + offset;
+        }
+        /* Move on to a block kept by a previous reset, if any. */
+        if (!b->next || b->next->size < size) {
+            break;
+        }
+        b = b->next;
+        b->used = 0;
+        a->current = b;
+    }
+    b = arena_grow(a, size);
+    a->current = b;
+    b->used = size;
+    return b->data;
+}
+
+/* Allocate zeroed memory suitably aligned for any type. */
+void *
+arena_alloc(struct arena *a, size_t size)
+{
+    void *p = arena_alloc_aligned(a, size, ARENA_ALIGN);
+    memset(p, 0, size);
+    return p;
+}
+
+/* Copy len bytes of a string into the arena and terminate it. */
+char *
+arena_strndup(struct arena *a, const char *s, size_t len)
+{
+    char *c = arena_alloc_aligned(a, len + 1, 1);
+    memcpy(c, s, len);
+    c[len] = '\0';
+    return c;
+}
+
+char *
+arena_strdup(struct arena *a, const char *s)
+{
+    s = s ? s : "";
+    return arena_strndup(a, s, strlen(s));
+}
+
+/*
+ * Take over the allocations of another arena, which is left empty.  The
+ * blocks in use are placed before the blocks of this arena, where they are
+ * not allocated from until the arena is reset.  Spare blocks are freed.
+ */
+void
+arena_adopt(struct arena *a, struct arena *from)
+{
+    struct arena_block *last = from->current;
+    struct arena_block *b;
+
+    if (last) {
+        while ((b = last->next)) {
+            last->next = b->next;
+            bail_free(ALLOC_STRINGS, b);
+        }
+        if (a->head) {
+            last->next = a->head;
+        } else {
+            a->current = last;
+        }
+        a->head = from->head;
+    }
+    from->head = NULL;
+    from->current = NULL;
+}
+
+/* Release all allocations, but keep the blocks for reuse. */
+void
+arena_reset(struct arena *a)
+{
+    a->current = a->head;
+    if (a->current) {
+        a->current->used = 0;
+    }
+}
+
+/* Release all allocations and the blocks. */
+void
+arena_destroy(struct arena *a)
+{
+    struct arena_block *b;
+
+    while ((b = a->head)) {
+        a->head = b->next;
+        bail_free(ALLOC_STRINGS, b);
+    }
+    a->current = NULL;
+}
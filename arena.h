@@ -0,0 +1,37 @@
+/*
+ * Arena (bump) allocator.
+ *
+ * Memory is carved sequentially out of a few large blocks, and is released
+ * all at once, either by resetting the arena to reuse the blocks or by
+ * destroying it.  Individual allocations are never freed.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (1024 * 1024)
+
+struct arena_block {
+    struct arena_block *next;
+    size_t size;              /* Usable bytes in data. */
+    size_t used;              /* Bytes handed out from data. */
+    char data[];
+};
+
+struct arena {
+    struct arena_block *head;     /* First block. */
+    struct arena_block *current;  /* Block being allocated from. */
+    size_t block_size;            /* Size of new blocks. */
+};
+
+void arena_init(struct arena *a, size_t block_size);
+void *arena_alloc(struct arena *a, size_t size);
+char *arena_strndup(struct arena *a, const char *s, size_t len);
+char *arena_strdup(struct arena *a, const char *s);
+void arena_adopt(struct arena *a, struct arena *from);
+void arena_reset(struct arena *a);
+void arena_destroy(struct arena *a);
+
+#endif
@@ -0,0 +1,339 @@
+/*
+ * Benchmark runner, used by "make bench".
+ *
+ * Runs emit, parse and scan over each input file and reports throughput in
+ * MB/s and events/s, peak RSS and the number of allocations.  Each command
+ * is run --repeat times and the fastest run is reported.  The number of
+ * events in a file is counted once with scan --stats, and allocations are
+ * counted by preloading allocstat.so.
+ *
+ * The programs are run from the current directory, or from the directory
+ * given with --bin, such as one of the optimized builds under build/.
+ *
+ * With --output FILE, the results are also saved as tab separated values,
+ * one line per file and command, so runs can be compared between commits.
+ * With --compare FILE, the change in time from a saved run is shown.
+ *
+ *    $ ./benchrun --repeat 3 --label $(git rev-parse --short HEAD) \
+ *          --output results.tsv bench-data/small.yaml bench-data/large.yaml
+ */
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define MAX_ARGS 8
+
+/*
+ * The commands to run; the program is looked up in the --bin directory and
+ * the input file is appended to the arguments.
+ */
+static const struct command {
+    const char *name;
+    const char *argv[MAX_ARGS];
+} commands[] = {
+    {"scan-stats", {"scan", "--stats"}},
+    {"scan", {"scan"}},
+    {"parse", {"parse"}},
+    {"parse-stream", {"parse", "--stream"}},
+    {"emit", {"emit"}},
+};
+
+#define NCOMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+/* The measurements of a run. */
+struct result {
+    double seconds;
+    long max_rss;               /* Kilobytes. */
+    unsigned long allocations;
+    unsigned long allocated;    /* Bytes. */
+};
+
+/* A result loaded with --compare. */
+struct baseline {
+    char file[PATH_MAX];
+    char command[32];
+    double seconds;
+};
+
+static struct baseline *baselines;
+static size_t nbaselines;
+
+/* Directory of the programs. */
+static const char *bin = ".";
+
+void
+usage(void)
+{
+    fprintf(stderr, "usage: benchrun [--bin DIR] [--repeat N] [--label NAME] [--output FILE] [--compare FILE]\n"
+                    "                input.yaml...\n");
+    exit(EXIT_FAILURE);
+}
+
+double
+now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*
+ * Run a command with stdout redirected to a file descriptor, and measure it.
+ * Returns 0 on success or -1 if the command failed.
+ */
+int
+run(const char *const *argv, int out, const char *allocstat, struct result *r)
+{
+    char counts[] = "/tmp/benchrun-XXXXXX";
+    struct rusage usage;
+    double start;
+    FILE *fp;
+    pid_t pid;
+    int status;
+    int fd;
+
+    if ((fd = mkstemp(counts)) < 0) {
+        perror("mkstemp");
+        return -1;
+    }
+    close(fd);
+    memset(r, 0, sizeof(*r));
+    start = now();
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        unlink(counts);
+        return -1;
+    }
+    if (pid == 0) {
+        dup2(out, STDOUT_FILENO);
+        setenv("LD_PRELOAD", allocstat, 1);
+        setenv("ALLOCSTAT_FILE", counts, 1);
+        execv(argv[0], (char *const *)argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        unlink(counts);
+        return -1;
+    }
+    r->seconds = now() - start;
+    r->max_rss = usage.ru_maxrss;
+    if ((fp = fopen(counts, "r"))) {
+        if (fscanf(fp, "allocations %lu allocated-bytes %lu", &r->allocations, &r->allocated) != 2) {
+            r->allocations = r->allocated = 0;
+        }
+        fclose(fp);
+    }
+    unlink(counts);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s failed\n", argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Count the events of a file with scan --stats.  Returns 0 if they could not
+ * be counted.
+ */
+unsigned long
+count_events(const char *path)
+{
+    char scan[PATH_MAX];
+    const char *argv[] = {scan, "--stats", path, NULL};
+    unsigned long events = 0;
+    char line[256];
+    struct result r;
+    FILE *fp = tmpfile();
+
+    if (!fp) {
+        perror("tmpfile");
+        return 0;
+    }
+    snprintf(scan, sizeof(scan), "%s/scan", bin);
+    if (run(argv, fileno(fp), "", &r) == 0) {
+        rewind(fp);
+        while (fgets(line, sizeof(line), fp)) {
+            if (sscanf(line, "events %lu", &events) == 1) {
+                break;
+            }
+        }
+    }
+    fclose(fp);
+    return events;
+}
+
+/* Load the results of an earlier run for --compare. */
+void
+load_baselines(const char *path)
+{
+    struct baseline b;
+    char line[PATH_MAX + 256];
+    FILE *fp;
+
+    if (!(fp = fopen(path, "r"))) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        /* label, file, command, bytes, events, seconds, ... */
+        if (sscanf(line, "%*[^\t]\t%4095[^\t]\t%31[^\t]\t%*s\t%*s\t%lf", b.file, b.command, &b.seconds) == 3) {
+            baselines = realloc(baselines, (nbaselines + 1) * sizeof(*baselines));
+            if (!baselines) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+            baselines[nbaselines++] = b;
+        }
+    }
+    fclose(fp);
+}
+
+const struct baseline *
+find_baseline(const char *file, const char *command)
+{
+    for (size_t i = 0; i < nbaselines; i++) {
+        if (strcmp(baselines[i].file, file) == 0 && strcmp(baselines[i].command, command) == 0) {
+            return &baselines[i];
+        }
+    }
+    return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *label = "unknown";
+    const char *output = NULL;
+    char allocstat[PATH_MAX];
+    FILE *results = NULL;
+    int repeat = 1;
+    int failed = 0;
+    int devnull;
+    struct option options[] = {
+        {"bin", required_argument, NULL, 'b'},
+        {"repeat", required_argument, NULL, 'r'},
+        {"label", required_argument, NULL, 'l'},
+        {"output", required_argument, NULL, 'o'},
+        {"compare", required_argument, NULL, 'c'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "b:r:l:o:c:", options, NULL)) != -1) {
+        switch (opt) {
+        case 'b':
+            bin = optarg;
+            break;
+        case 'r':
+            if ((repeat = atoi(optarg)) < 1) {
+                usage();
+            }
+            break;
+        case 'l':
+            label = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'c':
+            load_baselines(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind == argc) {
+        usage();
+    }
+    /* The preloaded library must be found from any directory. */
+    if (!realpath("allocstat.so", allocstat)) {
+        perror("allocstat.so");
+        return EXIT_FAILURE;
+    }
+    if ((devnull = open("/dev/null", O_WRONLY)) < 0) {
+        perror("/dev/null");
+        return EXIT_FAILURE;
+    }
+    if (output) {
+        if (!(results = fopen(output, "w"))) {
+            perror(output);
+            return EXIT_FAILURE;
+        }
+        fprintf(results, "label\tfile\tcommand\tbytes\tevents\tseconds\tmb_per_sec\tevents_per_sec\t"
+                         "max_rss_kb\tallocations\tallocated_bytes\n");
+    }
+
+    printf("%-28s %-13s %9s %12s %10s %12s %14s\n",
+           "file", "command", "MB/s", "events/s", "rss-KB", "allocations", "alloc-bytes");
+    for (int i = optind; i < argc; i++) {
+        const char *path = argv[i];
+        unsigned long events;
+        struct stat st;
+
+        if (stat(path, &st) < 0) {
+            perror(path);
+            failed = 1;
+            continue;
+        }
+        events = count_events(path);
+        for (size_t c = 0; c < NCOMMANDS; c++) {
+            const char *args[MAX_ARGS + 2];
+            char program[PATH_MAX];
+            const struct baseline *b;
+            struct result best, r;
+            size_t n;
+
+            snprintf(program, sizeof(program), "%s/%s", bin, commands[c].argv[0]);
+            args[0] = program;
+            for (n = 1; commands[c].argv[n]; n++) {
+                args[n] = commands[c].argv[n];
+            }
+            args[n++] = path;
+            args[n] = NULL;
+            best.seconds = -1;
+            for (int k = 0; k < repeat; k++) {
+                if (run(args, devnull, allocstat, &r) < 0) {
+                    failed = 1;
+                    break;
+                }
+                if (best.seconds < 0 || r.seconds < best.seconds) {
+                    best = r;
+                }
+            }
+            if (best.seconds <= 0) {
+                continue;
+            }
+            printf("%-28s %-13s %9.1f %12.0f %10ld %12lu %14lu",
+                   path, commands[c].name, st.st_size / best.seconds / 1e6, events / best.seconds,
+                   best.max_rss, best.allocations, best.allocated);
+            if ((b = find_baseline(path, commands[c].name)) && b->seconds > 0) {
+                printf(" %+6.1f%%", 100.0 * (best.seconds - b->seconds) / b->seconds);
+            }
+            printf("\n");
+            fflush(stdout);
+            if (results) {
+                fprintf(results, "%s\t%s\t%s\t%lld\t%lu\t%.6f\t%.3f\t%.0f\t%ld\t%lu\t%lu\n",
+                        label, path, commands[c].name, (long long)st.st_size, events, best.seconds,
+                        st.st_size / best.seconds / 1e6, events / best.seconds,
+                        best.max_rss, best.allocations, best.allocated);
+            }
+        }
+    }
+    if (results && fclose(results) != 0) {
+        perror(output);
+        failed = 1;
+    }
+    free(baselines);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
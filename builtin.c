@@ -0,0 +1,40 @@
+/*
+ * Example program with a built-in catalog.
+ *
+ * The catalog of fruit.yaml is compiled into the program by yaml2c, so it
+ * is there at startup without parsing anything, in read-only data.  The
+ * output is the same as that of parse:
+ *
+ *    $ make builtin
+ *    $ ./builtin
+ *    fruit: name=apple, color=red, count=12
+ *      variety: name=macintosh, color=red, seedless=false
+ *    ...
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "snapshot.h"
+
+/* Generated from fruit.yaml, in fruit-data.c. */
+extern const struct snapshot fruit_data;
+
+int
+main(void)
+{
+    const struct snapshot *snap = &fruit_data;
+
+    for (size_t i = 0; i < snap->nfruits; i++) {
+        const struct snapshot_fruit *f = &snap->fruits[i];
+        const struct snapshot_variety *v = &snap->varieties[f->variety];
+
+        printf("fruit: name=%s, color=%s, count=%" PRId64 "\n",
+               snapshot_string(snap, f->name), snapshot_string(snap, f->color), f->count);
+        for (size_t j = 0; j < f->nvarieties; j++, v++) {
+            printf("  variety: name=%s, color=%s, seedless=%s\n", snapshot_string(snap, v->name),
+                   snapshot_string(snap, v->color), v->seedless ? "true" : "false");
+        }
+    }
+    return EXIT_SUCCESS;
+}
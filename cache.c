@@ -0,0 +1,146 @@
+/*
+ * Incremental loading of yaml streams which change between loads.
+ *
+ * The stream is split into documents (split.c), and each document is keyed
+ * by a hash of its bytes and its length.  A document which was in the
+ * previous load keeps the catalog it was loaded into then; only new and
+ * changed documents are parsed.  The fruits of all the documents are then
+ * collected in cache->catalog, in stream order, which shares the strings of
+ * the document catalogs (catalog_share()).  So a reload costs a pass over
+ * the input to split and hash it, parsing the changed documents, and
+ * copying the records.
+ *
+ * Documents are identified by their 64-bit hash and length alone; the old
+ * bytes are not kept to compare.
+ */
+
+#include <yaml.h>
+#include <string.h>
+
+#include "cache.h"
+#include "hash.h"
+#include "load.h"
+#include "split.h"
+
+/* Parse a document into a new catalog, or return NULL if it fails. */
+static struct catalog *
+load_document(const unsigned char *data, size_t size)
+{
+    struct parser_state state;
+    yaml_parser_t parser;
+    struct catalog *c = NULL;
+
+    parser_state_init(&state, NULL, NULL);
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, data, size);
+    if (load_events(&state, &parser) == SUCCESS) {
+        c = bail_alloc(sizeof(*c));
+        catalog_init(c);
+        catalog_append(c, &state.catalog);
+    }
+    yaml_parser_delete(&parser);
+    parser_state_destroy(&state);
+    return c;
+}
+
+static void
+free_catalog(struct catalog *c)
+{
+    if (c) {
+        catalog_destroy(c);
+        bail_free(ALLOC_OTHER, c);
+    }
+}
+
+void
+cache_init(struct cache *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    catalog_init(&cache->catalog);
+}
+
+/*
+ * Load a stream, reusing the documents of the previous load which have not
+ * changed.  The fruits are in cache->catalog, until the next load.  Returns
+ * SUCCESS, or FAILURE if any document failed to load, in which case the
+ * catalog holds the documents before it.
+ */
+int
+cache_load(struct cache *cache, const unsigned char *data, size_t size)
+{
+    struct span *spans;
+    size_t n = split_documents(data, size, &spans);
+    struct cache_entry *entries = bail_alloc(n * sizeof(*entries));
+    size_t *slots;
+    size_t nslots = 1;
+    int status = SUCCESS;
+
+    /* Index the previous documents by hash; each slot holds an index + 1. */
+    while (nslots < 2 * cache->nentries) {
+        nslots *= 2;
+    }
+    slots = bail_alloc(nslots * sizeof(*slots));
+    for (size_t i = 0; i < cache->nentries; i++) {
+        size_t j = cache->entries[i].hash & (nslots - 1);
+
+        while (slots[j]) {
+            j = (j + 1) & (nslots - 1);
+        }
+        slots[j] = i + 1;
+    }
+
+    cache->reused = 0;
+    cache->parsed = 0;
+    for (size_t i = 0; i < n; i++) {
+        struct cache_entry *e = &entries[i];
+        size_t j;
+
+        e->hash = hash_bytes(data + spans[i].offset, spans[i].length);
+        e->length = spans[i].length;
+        for (j = e->hash & (nslots - 1); slots[j]; j = (j + 1) & (nslots - 1)) {
+            struct cache_entry *old = &cache->entries[slots[j] - 1];
+
+            /* Each old document is reused once; a repeat is parsed again. */
+            if (old->catalog && old->hash == e->hash && old->length == e->length) {
+                e->catalog = old->catalog;
+                old->catalog = NULL;
+                cache->reused++;
+                break;
+            }
+        }
+        if (!e->catalog) {
+            e->catalog = load_document(data + spans[i].offset, spans[i].length);
+            cache->parsed++;
+        }
+    }
+
+    /* Release the documents which are gone, and collect the fruits. */
+    for (size_t i = 0; i < cache->nentries; i++) {
+        free_catalog(cache->entries[i].catalog);
+    }
+    bail_free(ALLOC_OTHER, cache->entries);
+    cache->entries = entries;
+    cache->nentries = n;
+    catalog_reset(&cache->catalog);
+    for (size_t i = 0; i < n && status == SUCCESS; i++) {
+        if (entries[i].catalog) {
+            catalog_share(&cache->catalog, entries[i].catalog);
+        } else {
+            status = FAILURE;
+        }
+    }
+    bail_free(ALLOC_OTHER, slots);
+    bail_free(ALLOC_OTHER, spans);
+    return status;
+}
+
+void
+cache_destroy(struct cache *cache)
+{
+    for (size_t i = 0; i < cache->nentries; i++) {
+        free_catalog(cache->entries[i].catalog);
+    }
+    bail_free(ALLOC_OTHER, cache->entries);
+    catalog_destroy(&cache->catalog);
+    memset(cache, 0, sizeof(*cache));
+}
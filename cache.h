@@ -0,0 +1,32 @@
+/*
+ * Incremental loading of yaml streams which change between loads.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fruit.h"
+
+/* A document of the last load. */
+struct cache_entry {
+    uint64_t hash;              /* Hash of the document bytes. */
+    size_t length;              /* Length of the document. */
+    struct catalog *catalog;    /* Its fruits, or NULL if it failed to load. */
+};
+
+struct cache {
+    struct cache_entry *entries;
+    size_t nentries;
+    struct catalog catalog;     /* All the fruits, sharing the entries' strings. */
+    size_t reused;              /* Documents reused by the last load. */
+    size_t parsed;              /* Documents parsed by the last load. */
+};
+
+void cache_init(struct cache *cache);
+int cache_load(struct cache *cache, const unsigned char *data, size_t size);
+void cache_destroy(struct cache *cache);
+
+#endif
@@ -60,169 +60,416 @@
  *     $ make emit
  *     $ ./emit
  *
+ * Given a yaml file, emit loads the catalog from it and writes it out again.
+ * By default the catalog is written by the fast writer in writer.c, when it
+ * can produce the same output as the libyaml emitter.  Use --reference to
+ * always use the libyaml emitter, or --check to write the catalog both ways
+ * and compare the results.
+ *
+ * Output goes through large buffers straight to the file descriptor
+ * (output.c).  Use --output to write to a file, --direct to write the file
+ * with O_DIRECT, and --buffer-size to change the size of the buffer.
+ *
  * See the libyaml project page http://pyyaml.org/wiki/LibYAML
  */
 #include <yaml.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <unistd.h>
 
 #include "fruit.h"
+#include "input.h"
+#include "load.h"
+#include "output.h"
+#include "writer.h"
+
+/* Create our list of lists.  Varieties are added before their fruit. */
+void
+example_catalog(struct catalog *catalog)
+{
+    catalog_add_variety(catalog, "macintosh", "red", false);
+    catalog_add_variety(catalog, "granny smith", "green", false);
+    catalog_add_variety(catalog, "red delicious", "red", false);
+    catalog_add_fruit(catalog, "apple", "red", 12);
+
+    catalog_add_variety(catalog, "naval", "orange", false);
+    catalog_add_variety(catalog, "clementine", "orange", true);
+    catalog_add_variety(catalog, "valencia", "orange", false);
+    catalog_add_fruit(catalog, "orange", "orange", 3);
+
+    catalog_add_variety(catalog, "cavendish", "yellow", true);
+    catalog_add_variety(catalog, "plantain", "green", true);
+    catalog_add_fruit(catalog, "bannana", "yellow", 4);
+
+    catalog_add_variety(catalog, "honey", "yellow", false);
+    catalog_add_fruit(catalog, "mango", "green", 1);
+}
 
-int main(int argc, char *argv[])
+/*
+ * Emit the catalog as yaml with the libyaml emitter.
+ */
+int
+emit_catalog(yaml_emitter_t *emitter, struct catalog *catalog)
 {
-    yaml_emitter_t emitter;
     yaml_event_t event;
-    struct fruit *fruits = NULL;
-    struct variety *varieties = NULL;
-
-    /* Create our list of lists. */
-    varieties = NULL;
-    add_variety(&varieties, "macintosh", "red", false);
-    add_variety(&varieties, "granny smith", "green", false);
-    add_variety(&varieties, "red delicious", "red", false);
-    add_fruit(&fruits, "apple", "red", 12, varieties);
-
-    varieties = NULL;
-    add_variety(&varieties, "naval", "orange", false);
-    add_variety(&varieties, "clementine", "orange", true);
-    add_variety(&varieties, "valencia", "orange", false);
-    add_fruit(&fruits, "orange", "orange", 3, varieties);
-
-    varieties = NULL;
-    add_variety(&varieties, "cavendish", "yellow", true);
-    add_variety(&varieties, "plantain", "green", true);
-    add_fruit(&fruits, "bannana", "yellow", 4, varieties);
-
-    varieties = NULL;
-    add_variety(&varieties, "honey", "yellow", false);
-    add_fruit(&fruits, "mango", "green", 1, varieties);
-
-    /* Emit list of lists as yaml. */
-    yaml_emitter_initialize(&emitter);
-    yaml_emitter_set_output_file(&emitter, stdout);
 
     yaml_stream_start_event_initialize(&event, YAML_UTF8_ENCODING);
-    if (!yaml_emitter_emit(&emitter, &event)) goto error;
+    if (!yaml_emitter_emit(emitter, &event)) goto error;
 
     yaml_document_start_event_initialize(&event, NULL, NULL, NULL, 0);
-    if (!yaml_emitter_emit(&emitter, &event)) goto error;
+    if (!yaml_emitter_emit(emitter, &event)) goto error;
 
     yaml_mapping_start_event_initialize(&event, NULL, (yaml_char_t *)YAML_MAP_TAG,
         1, YAML_ANY_MAPPING_STYLE);
-    if (!yaml_emitter_emit(&emitter, &event)) goto error;
+    if (!yaml_emitter_emit(emitter, &event)) goto error;
 
     yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_STR_TAG,
         (yaml_char_t *)"fruit", strlen("fruit"), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-    if (!yaml_emitter_emit(&emitter, &event)) goto error;
+    if (!yaml_emitter_emit(emitter, &event)) goto error;
 
     yaml_sequence_start_event_initialize(&event, NULL, (yaml_char_t *)YAML_SEQ_TAG,
        1, YAML_ANY_SEQUENCE_STYLE);
-    if (!yaml_emitter_emit(&emitter, &event)) goto error;
+    if (!yaml_emitter_emit(emitter, &event)) goto error;
 
-    for (struct fruit *f = fruits; f; f = f->next) {
+    for (size_t i = 0; i < catalog->nfruits; i++) {
+        struct catalog_fruit *f = &catalog->fruits[i];
         char buffer[80];
 
         yaml_mapping_start_event_initialize(&event, NULL, (yaml_char_t *)YAML_MAP_TAG,
             1, YAML_ANY_MAPPING_STYLE);
-        if (!yaml_emitter_emit(&emitter, &event)) goto error;
+        if (!yaml_emitter_emit(emitter, &event)) goto error;
 
         yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_STR_TAG,
             (yaml_char_t *)"name", strlen("name"), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-        if (!yaml_emitter_emit(&emitter, &event)) goto error;
+        if (!yaml_emitter_emit(emitter, &event)) goto error;
 
         yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_STR_TAG,
             (yaml_char_t *)f->name, strlen(f->name), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-        if (!yaml_emitter_emit(&emitter, &event)) goto error;
+        if (!yaml_emitter_emit(emitter, &event)) goto error;
 
         yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_STR_TAG,
             (yaml_char_t *)"color", strlen("color"), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-        if (!yaml_emitter_emit(&emitter, &event)) goto error;
+        if (!yaml_emitter_emit(emitter, &event)) goto error;
 
         yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_STR_TAG,
             (yaml_char_t *)f->color, strlen(f->color), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-        if (!yaml_emitter_emit(&emitter, &event)) goto error;
+        if (!yaml_emitter_emit(emitter, &event)) goto error;
 
         yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_STR_TAG,
             (yaml_char_t *)"count", strlen("count"), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-        if (!yaml_emitter_emit(&emitter, &event)) goto error;
+        if (!yaml_emitter_emit(emitter, &event)) goto error;
 
-        if (snprintf(buffer, sizeof(buffer), "%d", f->count) >= sizeof(buffer)) {
+        if (snprintf(buffer, sizeof(buffer), "%" PRId64, f->count) >= sizeof(buffer)) {
             bail("buffer truncation");
         }
         yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_INT_TAG,
             (yaml_char_t *)buffer, strlen(buffer), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-        if (!yaml_emitter_emit(&emitter, &event)) goto error;
+        if (!yaml_emitter_emit(emitter, &event)) goto error;
 
-        if (f->varieties) {
+        if (f->nvarieties > 0) {
             yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_STR_TAG,
                 (yaml_char_t *)"varieties", strlen("varieties"), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-            if (!yaml_emitter_emit(&emitter, &event)) goto error;
+            if (!yaml_emitter_emit(emitter, &event)) goto error;
 
             yaml_sequence_start_event_initialize(&event, NULL, (yaml_char_t *)YAML_SEQ_TAG,
                 1, YAML_ANY_SEQUENCE_STYLE);
-            if (!yaml_emitter_emit(&emitter, &event)) goto error;
+            if (!yaml_emitter_emit(emitter, &event)) goto error;
 
-            for (struct variety *v = f->varieties; v; v = v->next) {
+            struct catalog_variety *v = catalog_varieties(catalog, f);
+            for (size_t j = 0; j < f->nvarieties; j++, v++) {
                 yaml_mapping_start_event_initialize(&event, NULL, (yaml_char_t *)YAML_MAP_TAG,
                     1, YAML_ANY_MAPPING_STYLE);
-                if (!yaml_emitter_emit(&emitter, &event)) goto error;
+                if (!yaml_emitter_emit(emitter, &event)) goto error;
 
                 yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_STR_TAG,
                     (yaml_char_t *)"name", strlen("name"), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-                if (!yaml_emitter_emit(&emitter, &event)) goto error;
+                if (!yaml_emitter_emit(emitter, &event)) goto error;
 
                 yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_STR_TAG,
                     (yaml_char_t *)v->name, strlen(v->name), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-                if (!yaml_emitter_emit(&emitter, &event)) goto error;
+                if (!yaml_emitter_emit(emitter, &event)) goto error;
 
                 yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_STR_TAG,
                     (yaml_char_t *)"color", strlen("color"), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-                if (!yaml_emitter_emit(&emitter, &event)) goto error;
+                if (!yaml_emitter_emit(emitter, &event)) goto error;
 
                 yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_STR_TAG,
                     (yaml_char_t *)v->color, strlen(v->color), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-                if (!yaml_emitter_emit(&emitter, &event)) goto error;
+                if (!yaml_emitter_emit(emitter, &event)) goto error;
 
                 yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_STR_TAG,
                     (yaml_char_t *)"seedless", strlen("seedless"), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-                if (!yaml_emitter_emit(&emitter, &event)) goto error;
+                if (!yaml_emitter_emit(emitter, &event)) goto error;
 
                 yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)YAML_INT_TAG,
                     (yaml_char_t *)(v->seedless ? "true" : "false"),
                     strlen(v->seedless ? "true" : "false"), 1, 0, YAML_PLAIN_SCALAR_STYLE);
-                if (!yaml_emitter_emit(&emitter, &event)) goto error;
+                if (!yaml_emitter_emit(emitter, &event)) goto error;
 
                 yaml_mapping_end_event_initialize(&event);
-                if (!yaml_emitter_emit(&emitter, &event)) goto error;
+                if (!yaml_emitter_emit(emitter, &event)) goto error;
             }
             yaml_sequence_end_event_initialize(&event);
-            if (!yaml_emitter_emit(&emitter, &event)) goto error;
+            if (!yaml_emitter_emit(emitter, &event)) goto error;
         }
 
         yaml_mapping_end_event_initialize(&event);
-        if (!yaml_emitter_emit(&emitter, &event)) goto error;
+        if (!yaml_emitter_emit(emitter, &event)) goto error;
     }
 
     yaml_sequence_end_event_initialize(&event);
-    if (!yaml_emitter_emit(&emitter, &event)) goto error;
+    if (!yaml_emitter_emit(emitter, &event)) goto error;
 
     yaml_mapping_end_event_initialize(&event);
-    if (!yaml_emitter_emit(&emitter, &event)) goto error;
+    if (!yaml_emitter_emit(emitter, &event)) goto error;
 
     yaml_document_end_event_initialize(&event, 0);
-    if (!yaml_emitter_emit(&emitter, &event)) goto error;
+    if (!yaml_emitter_emit(emitter, &event)) goto error;
 
     yaml_stream_end_event_initialize(&event);
-    if (!yaml_emitter_emit(&emitter, &event)) goto error;
+    if (!yaml_emitter_emit(emitter, &event)) goto error;
 
-    yaml_emitter_delete(&emitter);
-    destroy_fruits(&fruits);
-    return EXIT_SUCCESS;
+    return SUCCESS;
 
 error:
-    fprintf(stderr, "Failed to emit event %d: %s\n", event.type, emitter.problem);
+    fprintf(stderr, "Failed to emit event %d: %s\n", event.type, emitter->problem);
+    return FAILURE;
+}
+
+/*
+ * Write the catalog, with the fast writer if the catalog allows it, or with
+ * the libyaml emitter.
+ */
+int
+output_catalog(struct catalog *catalog, struct output *out, int reference)
+{
+    yaml_emitter_t emitter;
+    int status;
+
+    if (!reference && writer_supports(catalog)) {
+        return write_catalog(catalog, out) == 0 ? SUCCESS : FAILURE;
+    }
+    yaml_emitter_initialize(&emitter);
+    yaml_emitter_set_output(&emitter, output_handler, out);
+    status = emit_catalog(&emitter, catalog);
     yaml_emitter_delete(&emitter);
-    destroy_fruits(&fruits);
-    return EXIT_FAILURE;
+    return status;
+}
+
+/*
+ * Write the catalog to a temporary file and read it back.
+ */
+int
+render_catalog(struct catalog *catalog, int reference, struct input *result)
+{
+    struct output out;
+    FILE *fp;
+    int status;
+    int error;
+
+    if (!(fp = tmpfile())) {
+        perror("tmpfile");
+        return FAILURE;
+    }
+    if ((error = output_open_fd(&out, fileno(fp), 0))) {
+        bail(strerror(error));
+    }
+    status = output_catalog(catalog, &out, reference);
+    if ((error = output_close(&out))) {
+        fprintf(stderr, "write: %s\n", strerror(error));
+        status = FAILURE;
+    }
+    rewind(fp);
+    if (status == SUCCESS && (error = input_read(result, fp))) {
+        fprintf(stderr, "read: %s\n", strerror(error));
+        status = FAILURE;
+    }
+    fclose(fp);
+    return status;
+}
+
+/*
+ * Write the catalog with both the libyaml emitter and the fast writer, and
+ * compare the results.
+ */
+int
+check_catalog(struct catalog *catalog)
+{
+    struct input expected;
+    struct input actual;
+    size_t i;
+    int status;
+
+    if (!writer_supports(catalog)) {
+        fprintf(stderr, "check: catalog needs the libyaml emitter\n");
+        return SUCCESS;
+    }
+    memset(&expected, 0, sizeof(expected));
+    memset(&actual, 0, sizeof(actual));
+    status = render_catalog(catalog, 1, &expected);
+    if (status == SUCCESS) {
+        status = render_catalog(catalog, 0, &actual);
+    }
+    if (status == SUCCESS) {
+        for (i = 0; i < expected.size && i < actual.size; i++) {
+            if (expected.data[i] != actual.data[i]) {
+                break;
+            }
+        }
+        if (i < expected.size || i < actual.size) {
+            fprintf(stderr, "check: outputs differ at byte %zu\n", i);
+            status = FAILURE;
+        } else if (writer_size(catalog) != actual.size) {
+            fprintf(stderr, "check: expected %zu bytes, got %zu\n", writer_size(catalog), actual.size);
+            status = FAILURE;
+        } else {
+            fprintf(stderr, "check: outputs are identical, %zu bytes\n", i);
+        }
+    }
+    input_close(&expected);
+    input_close(&actual);
+    return status;
+}
+
+/* Parse a size with an optional k or m suffix. */
+size_t
+parse_size(const char *s)
+{
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+
+    if (*end == 'k' || *end == 'K') {
+        n *= 1024;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        n *= 1024 * 1024;
+        end++;
+    }
+    if (end == s || *end != '\0' || n == 0) {
+        return 0;
+    }
+    return n;
+}
+
+void
+usage(void)
+{
+    fprintf(stderr, "usage: emit [--reference | --check] [--output FILE [--direct]] [--buffer-size N[k|m]]\n"
+                    "            [input.yaml]\n");
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * Load a catalog from a yaml file.
+ */
+int
+load_catalog(struct catalog *catalog, const char *path)
+{
+    struct parser_state state;
+    yaml_parser_t parser;
+    struct input input;
+    int error;
+    int status;
+
+    if ((error = input_map(&input, path))) {
+        fprintf(stderr, "%s: %s\n", path, strerror(error));
+        return FAILURE;
+    }
+    parser_state_init(&state, NULL, NULL);
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, input.data, input.size);
+    status = load_events(&state, &parser);
+    if (status == SUCCESS) {
+        catalog_append(catalog, &state.catalog);
+    }
+    yaml_parser_delete(&parser);
+    parser_state_destroy(&state);
+    input_close(&input);
+    return status;
+}
+
+int main(int argc, char *argv[])
+{
+    struct catalog catalog;
+    struct output out;
+    const char *path = NULL;
+    size_t buffer_size = 0;
+    int reference = 0;
+    int check = 0;
+    int direct = 0;
+    int status;
+    int error;
+    struct option options[] = {
+        {"reference", no_argument, NULL, 'r'},
+        {"check", no_argument, NULL, 'c'},
+        {"output", required_argument, NULL, 'o'},
+        {"direct", no_argument, NULL, 'd'},
+        {"buffer-size", required_argument, NULL, 'b'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "rco:db:", options, NULL)) != -1) {
+        switch (opt) {
+        case 'r':
+            reference = 1;
+            break;
+        case 'c':
+            check = 1;
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        case 'd':
+            direct = 1;
+            break;
+        case 'b':
+            if (!(buffer_size = parse_size(optarg))) {
+                usage();
+            }
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind < argc - 1 || (reference && check) || (direct && !path)) {
+        usage();
+    }
+
+    catalog_init(&catalog);
+    if (optind < argc) {
+        status = load_catalog(&catalog, argv[optind]);
+    } else {
+        example_catalog(&catalog);
+        status = SUCCESS;
+    }
+    if (status == SUCCESS && check) {
+        status = check_catalog(&catalog);
+    } else if (status == SUCCESS) {
+        if (path) {
+            /* The size is known in advance when the fast writer is used. */
+            off_t size = -1;
+            if (!reference && writer_supports(&catalog)) {
+                size = writer_size(&catalog);
+            }
+            error = output_open(&out, path, buffer_size, size, direct);
+        } else {
+            error = output_open_fd(&out, STDOUT_FILENO, buffer_size);
+        }
+        if (error) {
+            fprintf(stderr, "%s: %s\n", path ? path : "stdout", strerror(error));
+            status = FAILURE;
+        } else {
+            status = output_catalog(&catalog, &out, reference);
+            if ((error = output_close(&out))) {
+                fprintf(stderr, "%s: %s\n", path ? path : "stdout", strerror(error));
+                status = FAILURE;
+            }
+        }
+    }
+    catalog_destroy(&catalog);
+    return status == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -13,6 +13,7 @@
 #include <string.h>
 
 #include "fruit.h"
+#include "names.h"
 
 /* Helper to bail on error. */
 void
@@ -22,80 +23,476 @@ bail(const char *msg)
     exit(1);
 }
 
-/* Helper to allocate memory or bail. */
+/*
+ * Helper to allocate memory or bail.  The _as variants count the memory in
+ * an allocation category (alloc.h); memory from them is freed with
+ * bail_free() in the same category.
+ */
 void *
-bail_alloc(size_t size)
+bail_alloc_as(enum alloc_category category, size_t size)
 {
     void *p = calloc(1, size);
+
     if (!p) {
         bail("out of memory");
     }
+    alloc_count(category, p);
     return p;
 }
 
+void *
+bail_alloc(size_t size)
+{
+    return bail_alloc_as(ALLOC_OTHER, size);
+}
+
+/* Helper to resize memory or bail. */
+void *
+bail_realloc_as(enum alloc_category category, void *p, size_t size)
+{
+    /* The old block is uncounted first, as it is gone after realloc(). */
+    alloc_uncount(category, p);
+    p = realloc(p, size);
+    if (!p) {
+        bail("out of memory");
+    }
+    alloc_count(category, p);
+    return p;
+}
+
+void *
+bail_realloc(void *p, size_t size)
+{
+    return bail_realloc_as(ALLOC_OTHER, p, size);
+}
+
 /* Helper to copy a string or bail. */
 char *
 bail_strdup(const char *s)
 {
     char *c = strdup(s ? s : "");
+
     if (!c) {
         bail("out of memory");
     }
+    alloc_count(ALLOC_STRINGS, c);
     return c;
 }
 
+/* Free memory from the helpers above. */
 void
-add_fruit(struct fruit **fruits, char *name, char *color, int count, struct variety *varieties)
+bail_free(enum alloc_category category, void *p)
 {
-    /* Create fruit object. */
-    struct fruit *f = bail_alloc(sizeof(*f));
-    f->name = bail_strdup(name);
-    f->color = bail_strdup(color);
-    f->count = count;
-    f->varieties = varieties;
+    alloc_uncount(category, p);
+    free(p);
+}
+
+void
+catalog_init(struct catalog *c)
+{
+    memset(c, 0, sizeof(*c));
+    arena_init(&c->arena, 0);
+    intern_init(&c->strings, &c->arena);
+}
 
-    /* Append to list. */
-    if (!*fruits) {
-        *fruits = f;
+/* Move a catalog to another place in memory, leaving the old one empty. */
+void
+catalog_move(struct catalog *to, struct catalog *from)
+{
+    *to = *from;
+    to->strings.arena = &to->arena;
+    catalog_init(from);
+}
+
+/* Copy a string into the catalog's arena. */
+char *
+catalog_strndup(struct catalog *c, const char *s, size_t len)
+{
+    return arena_strndup(&c->arena, s, len);
+}
+
+char *
+catalog_strdup(struct catalog *c, const char *s)
+{
+    return arena_strdup(&c->arena, s);
+}
+
+/* Get the single shared copy of a string in the catalog. */
+const char *
+catalog_intern(struct catalog *c, const char *s, size_t len)
+{
+    return intern_string(&c->strings, s, len);
+}
+
+/* Make room in the variety table for n more varieties. */
+static void
+catalog_reserve_varieties(struct catalog *c, size_t n)
+{
+    if (c->nvarieties + n > c->varieties_size) {
+        while (c->nvarieties + n > c->varieties_size) {
+            c->varieties_size = c->varieties_size ? c->varieties_size * 2 : 16;
+        }
+        c->varieties = bail_realloc_as(ALLOC_VARIETIES, c->varieties, c->varieties_size * sizeof(*c->varieties));
+    }
+}
+
+/*
+ * Add a fruit which has the name of an earlier one to a catalog with a name
+ * index, according to the policy of the index.  Returns the index plus one
+ * of the earlier fruit, which has been updated, or 0 if the fruit is
+ * rejected.
+ *
+ * The varieties of the earlier fruit are replaced by the new ones, or merged
+ * with them, in place if they are just before the new ones.  Otherwise they
+ * are left unused in the table, and the table is compacted once the unused
+ * records are as many as the others.
+ */
+static size_t
+catalog_add_duplicate(struct catalog *c, struct catalog_fruit *f, const char *color, int64_t count)
+{
+    size_t fruit = f - c->fruits;
+    size_t first = c->claimed;
+    size_t added = c->nvarieties - first;
+    size_t old = f->nvarieties;
+    size_t start = first;
+
+    c->names->duplicates++;
+    if (c->names->policy == DUPLICATES_REJECT) {
+        c->nvarieties = first;
+        return 0;
+    }
+    names_remove_varieties(c->names, c, fruit, f->variety, f->variety + old);
+    if (f->variety + old == first) {
+        start = f->variety;
+        if (c->names->policy == DUPLICATES_LAST) {
+            memmove(&c->varieties[start], &c->varieties[first], added * sizeof(*c->varieties));
+            c->nvarieties = start + added;
+        }
     } else {
-        struct fruit *tail = *fruits;
-        while (tail->next) {
-            tail = tail->next;
+        if (c->names->policy == DUPLICATES_MERGE) {
+            /* Copy the earlier varieties in front of the new ones, so they are together. */
+            catalog_reserve_varieties(c, old);
+            memmove(&c->varieties[first + old], &c->varieties[first], added * sizeof(*c->varieties));
+            memcpy(&c->varieties[first], &c->varieties[f->variety], old * sizeof(*c->varieties));
+            c->nvarieties += old;
         }
-        tail->next = f;
+        c->dead += old;
     }
+    /* Index the varieties together, so the new ones replace earlier ones of the same name. */
+    c->claimed = start;
+    names_add_varieties(c->names, c, fruit);
+    f->color = color;
+    f->count = count;
+    f->variety = start;
+    f->nvarieties = c->nvarieties - start;
+    f->unparsed = 0;
+    c->claimed = c->nvarieties;
+    if (c->dead * 2 > c->claimed) {
+        catalog_compact(c);
+    }
+    return fruit + 1;
+}
+
+/*
+ * Append a fruit to the catalog.
+ *
+ * The new fruit takes ownership of all the varieties added since the
+ * previous fruit, so add the varieties first, then the fruit they belong to.
+ *
+ * Returns the index plus one of the fruit added.  If the catalog has a name
+ * index, a fruit with the name of an earlier one, or with varieties of the
+ * same name, is handled by the duplicates policy of the index: the index
+ * returned may then be that of the earlier fruit, or 0 if the fruit is
+ * rejected.  The varieties of fruits must all be parsed.
+ */
+size_t
+catalog_add_fruit(struct catalog *c, const char *name, const char *color, int64_t count)
+{
+    struct catalog_fruit *f;
+    size_t first = c->claimed;
+    size_t existing;
+
+    name = name ? name : "";
+    color = color ? color : "";
+    if (c->names) {
+        if ((existing = names_find_fruit(c->names, c, name))) {
+            return catalog_add_duplicate(c, &c->fruits[existing - 1], color, count);
+        }
+        if (names_add_varieties(c->names, c, c->nfruits) && c->names->policy == DUPLICATES_REJECT) {
+            names_remove_varieties(c->names, c, c->nfruits, first, c->nvarieties);
+            c->nvarieties = first;
+            return 0;
+        }
+    }
+    if (c->nfruits == c->fruits_size) {
+        c->fruits_size = c->fruits_size ? c->fruits_size * 2 : 16;
+        c->fruits = bail_realloc_as(ALLOC_FRUITS, c->fruits, c->fruits_size * sizeof(*c->fruits));
+    }
+    f = &c->fruits[c->nfruits++];
+    f->name = name;
+    f->color = color;
+    f->count = count;
+    f->variety = first;
+    f->nvarieties = c->nvarieties - first;
+    f->unparsed = 0;
+    c->claimed = c->nvarieties;
+    if (c->names) {
+        names_add_fruit(c->names, c, c->nfruits - 1);
+    }
+    return c->nfruits;
 }
 
+/* Append a variety to the catalog, to be claimed by the next fruit added. */
 void
-add_variety(struct variety **varieties, char *name, char *color, bool seedless)
+catalog_add_variety(struct catalog *c, const char *name, const char *color, bool seedless)
 {
-    /* Create variety object. */
-    struct variety *v = bail_alloc(sizeof(*v));
-    v->name = bail_strdup(name);
-    v->color = bail_strdup(color);
+    struct catalog_variety *v;
+
+    catalog_reserve_varieties(c, 1);
+    v = &c->varieties[c->nvarieties++];
+    v->name = name ? name : "";
+    v->color = color ? color : "";
     v->seedless = seedless;
+}
 
-    /* Append to list. */
-    if (!*varieties) {
-        *varieties = v;
-    } else {
-        struct variety *tail = *varieties;
-        while (tail->next) {
-            tail = tail->next;
+/* Get the first of the varieties of a fruit in the catalog. */
+struct catalog_variety *
+catalog_varieties(const struct catalog *c, const struct catalog_fruit *f)
+{
+    return &c->varieties[f->variety];
+}
+
+/*
+ * Record the yaml of varieties which are not parsed yet, and return the
+ * value for the unparsed member of their fruit.
+ */
+size_t
+catalog_add_range(struct catalog *c, size_t offset, size_t length, size_t column)
+{
+    struct catalog_range *r;
+
+    if (c->nranges == c->ranges_size) {
+        c->ranges_size = c->ranges_size ? c->ranges_size * 2 : 16;
+        c->ranges = bail_realloc_as(ALLOC_FRUITS, c->ranges, c->ranges_size * sizeof(*c->ranges));
+    }
+    r = &c->ranges[c->nranges++];
+    r->offset = offset;
+    r->length = length;
+    r->column = column;
+    return c->nranges;
+}
+
+/*
+ * Get the first of the varieties of a fruit, parsing them first if they
+ * were left unparsed by a lazy load.  Returns NULL if they fail to parse,
+ * after reporting the errors.  A catalog is not safe to access from several
+ * threads while it has unparsed varieties.
+ */
+struct catalog_variety *
+catalog_load_varieties(struct catalog *c, struct catalog_fruit *f)
+{
+    static struct catalog_variety none;
+
+    if (f->unparsed && (!c->load_varieties || !c->load_varieties(c, f))) {
+        return NULL;
+    }
+    /* A catalog without varieties has no table to point into. */
+    return c->varieties ? &c->varieties[f->variety] : &none;
+}
+
+/* Get the string to use in c for a string of catalog from. */
+static const char *
+catalog_adopt_string(struct catalog *c, struct catalog *from, const char *s)
+{
+    size_t len = strlen(s);
+
+    /* Interned strings must be interned again to stay unique. */
+    if (intern_lookup(&from->strings, s, len) == s) {
+        return catalog_intern(c, s, len);
+    }
+    return s;
+}
+
+/*
+ * Move the fruits of one catalog to the end of another.  The strings are not
+ * copied; the arena which holds them is taken over.  The catalog moved from
+ * is left empty.
+ */
+void
+catalog_append(struct catalog *c, struct catalog *from)
+{
+    for (size_t i = 0; i < from->nfruits; i++) {
+        struct catalog_fruit *f = &from->fruits[i];
+        struct catalog_variety *v = catalog_load_varieties(from, f);
+
+        for (size_t j = 0; v && j < f->nvarieties; j++, v++) {
+            catalog_add_variety(c, catalog_adopt_string(c, from, v->name),
+                                catalog_adopt_string(c, from, v->color), v->seedless);
         }
-        tail->next = v;
+        catalog_add_fruit(c, catalog_adopt_string(c, from, f->name),
+                          catalog_adopt_string(c, from, f->color), f->count);
+    }
+    arena_adopt(&c->arena, &from->arena);
+    intern_reset(&from->strings);
+    from->nfruits = 0;
+    from->nvarieties = 0;
+    from->claimed = 0;
+    from->dead = 0;
+    from->nranges = 0;
+    if (from->names) {
+        names_reset(from->names);
+    }
+}
+
+/*
+ * Append the records of another catalog, sharing its strings.  Nothing is
+ * copied but the records, so the catalog must not be used after the one
+ * shared from is reset or destroyed.  The strings are not interned again, so
+ * strings interned in different catalogs are not the same pointers.  The
+ * fruits shared must not have unparsed varieties, and are not added to a
+ * name index.
+ */
+void
+catalog_share(struct catalog *c, const struct catalog *from)
+{
+    size_t base = c->nvarieties;
+
+    if (c->nfruits + from->nfruits > c->fruits_size) {
+        while (c->nfruits + from->nfruits > c->fruits_size) {
+            c->fruits_size = c->fruits_size ? c->fruits_size * 2 : 16;
+        }
+        c->fruits = bail_realloc_as(ALLOC_FRUITS, c->fruits, c->fruits_size * sizeof(*c->fruits));
+    }
+    catalog_reserve_varieties(c, from->nvarieties);
+    memcpy(c->varieties + c->nvarieties, from->varieties, from->nvarieties * sizeof(*from->varieties));
+    c->nvarieties += from->nvarieties;
+    c->dead += from->dead;
+    for (size_t i = 0; i < from->nfruits; i++) {
+        c->fruits[c->nfruits] = from->fruits[i];
+        c->fruits[c->nfruits++].variety += base;
+    }
+    c->claimed = c->nvarieties;
+}
+
+/*
+ * Drop the variety records which duplicates have left unused, moving the
+ * varieties of the fruits together in the order of the fruits.  Pending
+ * varieties stay at the end.  The name index, if any, is updated.
+ */
+void
+catalog_compact(struct catalog *c)
+{
+    size_t pending = c->nvarieties - c->claimed;
+    struct catalog_variety *v;
+    size_t n = 0;
+
+    if (!c->dead) {
+        return;
+    }
+    v = bail_alloc_as(ALLOC_VARIETIES, c->varieties_size * sizeof(*v));
+    for (size_t i = 0; i < c->nfruits; i++) {
+        struct catalog_fruit *f = &c->fruits[i];
+
+        memcpy(v + n, &c->varieties[f->variety], f->nvarieties * sizeof(*v));
+        f->variety = n;
+        n += f->nvarieties;
+    }
+    memcpy(v + n, &c->varieties[c->claimed], pending * sizeof(*v));
+    bail_free(ALLOC_VARIETIES, c->varieties);
+    c->varieties = v;
+    c->claimed = n;
+    c->nvarieties = n + pending;
+    c->dead = 0;
+    if (c->names) {
+        names_index_varieties(c->names, c);
+    }
+}
+
+/*
+ * Append copies of the fruits of the catalog to a linked list of fruits,
+ * parsing the varieties left unparsed by a lazy load.  Returns 1, or 0 if
+ * the varieties of a fruit fail to parse, with the fruits before it copied.
+ */
+int
+catalog_to_fruits(struct catalog *c, struct fruit **fruits)
+{
+    struct fruit **tail = fruits;
+
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    for (size_t i = 0; i < c->nfruits; i++) {
+        struct catalog_fruit *cf = &c->fruits[i];
+        struct catalog_variety *cv = catalog_load_varieties(c, cf);
+        struct variety **vtail;
+        struct fruit *f;
+
+        if (!cv) {
+            return 0;
+        }
+        f = bail_alloc_as(ALLOC_FRUITS, sizeof(*f));
+        f->name = bail_strdup(cf->name);
+        f->color = bail_strdup(cf->color);
+        f->count = cf->count;
+        vtail = &f->varieties;
+        for (size_t j = 0; j < cf->nvarieties; j++) {
+            struct variety *v = bail_alloc_as(ALLOC_VARIETIES, sizeof(*v));
+            v->name = bail_strdup(cv[j].name);
+            v->color = bail_strdup(cv[j].color);
+            v->seedless = cv[j].seedless;
+            *vtail = v;
+            vtail = &v->next;
+        }
+        *tail = f;
+        tail = &f->next;
+    }
+    return 1;
+}
+
+/*
+ * Empty the catalog, keeping the tables and the arena blocks for reuse.  The
+ * strings from catalog_strdup() are released.
+ */
+void
+catalog_reset(struct catalog *c)
+{
+    c->nfruits = 0;
+    c->nvarieties = 0;
+    c->claimed = 0;
+    c->dead = 0;
+    c->nranges = 0;
+    if (c->names) {
+        names_reset(c->names);
+    }
+    intern_reset(&c->strings);
+    arena_reset(&c->arena);
+}
+
+void
+catalog_destroy(struct catalog *c)
+{
+    bail_free(ALLOC_FRUITS, c->fruits);
+    bail_free(ALLOC_VARIETIES, c->varieties);
+    bail_free(ALLOC_FRUITS, c->ranges);
+    if (c->names) {
+        names_destroy(c->names);
+        bail_free(ALLOC_NAMES, c->names);
     }
+    intern_destroy(&c->strings);
+    arena_destroy(&c->arena);
+    memset(c, 0, sizeof(*c));
 }
 
+/* Free a linked list of fruits, such as one from catalog_to_fruits(). */
 void
 destroy_fruits(struct fruit **fruits)
 {
     for (struct fruit *f = *fruits; f; f = *fruits) {
         *fruits = f->next;
-        free(f->name);
-        free(f->color);
+        bail_free(ALLOC_STRINGS, f->name);
+        bail_free(ALLOC_STRINGS, f->color);
         destroy_varieties(&f->varieties);
-        free(f);
+        bail_free(ALLOC_FRUITS, f);
     }
 }
 
@@ -104,8 +501,8 @@ destroy_varieties(struct variety **varieties)
 {
     for (struct variety *v = *varieties; v; v = *varieties) {
         *varieties = v->next;
-        free(v->name);
-        free(v->color);
-        free(v);
+        bail_free(ALLOC_STRINGS, v->name);
+        bail_free(ALLOC_STRINGS, v->color);
+        bail_free(ALLOC_VARIETIES, v);
     }
 }
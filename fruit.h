@@ -2,13 +2,22 @@
  * Example application data structures.
  */
 
+#ifndef FRUIT_H
+#define FRUIT_H
+
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "alloc.h"
+#include "arena.h"
+#include "intern.h"
 
 struct fruit {
     struct fruit *next;
     char *name;
     char *color;
-    int count;
+    int64_t count;
     struct variety *varieties;
 };
 
@@ -19,12 +28,95 @@ struct variety {
     bool seedless;
 };
 
+/*
+ * Catalog of fruits and varieties held in contiguous, growable tables.
+ *
+ * All the varieties of all the fruits share one table.  Each fruit refers to
+ * its own varieties by an index range into that table, so appending a record
+ * is amortized O(1) and the records stay packed together in memory.
+ *
+ * The catalog does not copy the strings given to it.  They must outlive the
+ * catalog, for example string literals or strings copied into the catalog's
+ * own arena with catalog_strdup(), which are all released at once.  Values
+ * which repeat a lot, such as colors, can be stored once with
+ * catalog_intern() and then compared by pointer.
+ */
+struct catalog_fruit {
+    const char *name;
+    const char *color;
+    int64_t count;
+    size_t variety;        /* Index of the first variety. */
+    size_t nvarieties;     /* Number of varieties. */
+    size_t unparsed;       /* Range of the varieties plus one, if not parsed yet. */
+};
+
+struct catalog_variety {
+    const char *name;
+    const char *color;
+    bool seedless;
+};
+
+/*
+ * The yaml of varieties which are parsed only when they are first accessed,
+ * see catalog_load_varieties().
+ */
+struct catalog_range {
+    size_t offset;          /* Start in the source. */
+    size_t length;
+    size_t column;          /* Column of the start. */
+};
+
+struct catalog;
+struct names;
+
+/* Parses the unparsed varieties of a fruit into the catalog. */
+typedef int (*varieties_loader)(struct catalog *c, struct catalog_fruit *f);
+
+struct catalog {
+    struct catalog_fruit *fruits;
+    size_t nfruits;
+    size_t fruits_size;       /* Allocated fruit table entries. */
+    struct catalog_variety *varieties;
+    size_t nvarieties;
+    size_t varieties_size;    /* Allocated variety table entries. */
+    size_t claimed;           /* Varieties claimed by a fruit; the rest are pending. */
+    size_t dead;              /* Claimed varieties which duplicates left unused. */
+    struct arena arena;       /* Storage for strings. */
+    struct intern strings;    /* Interned strings, stored in the arena. */
+    struct catalog_range *ranges;   /* Unparsed varieties. */
+    size_t nranges;
+    size_t ranges_size;
+    const unsigned char *source;    /* The yaml the ranges are in. */
+    varieties_loader load_varieties;
+    struct names *names;      /* Name index, if any; see names.h. */
+};
+
 void bail(const char *msg);
 void *bail_alloc(size_t size);
+void *bail_alloc_as(enum alloc_category category, size_t size);
+void *bail_realloc(void *p, size_t size);
+void *bail_realloc_as(enum alloc_category category, void *p, size_t size);
 char *bail_strdup(const char *s);
+void bail_free(enum alloc_category category, void *p);
 
-void add_fruit(struct fruit **fruits, char *name, char *color, int count, struct variety *varieties);
-void add_variety(struct variety **variety, char *name, char *color, bool seedless);
+void catalog_init(struct catalog *c);
+void catalog_move(struct catalog *to, struct catalog *from);
+char *catalog_strndup(struct catalog *c, const char *s, size_t len);
+char *catalog_strdup(struct catalog *c, const char *s);
+const char *catalog_intern(struct catalog *c, const char *s, size_t len);
+size_t catalog_add_fruit(struct catalog *c, const char *name, const char *color, int64_t count);
+void catalog_add_variety(struct catalog *c, const char *name, const char *color, bool seedless);
+struct catalog_variety *catalog_varieties(const struct catalog *c, const struct catalog_fruit *f);
+size_t catalog_add_range(struct catalog *c, size_t offset, size_t length, size_t column);
+struct catalog_variety *catalog_load_varieties(struct catalog *c, struct catalog_fruit *f);
+void catalog_append(struct catalog *c, struct catalog *from);
+void catalog_share(struct catalog *c, const struct catalog *from);
+void catalog_compact(struct catalog *c);
+int catalog_to_fruits(struct catalog *c, struct fruit **fruits);
+void catalog_reset(struct catalog *c);
+void catalog_destroy(struct catalog *c);
 
 void destroy_fruits(struct fruit **fruits);
 void destroy_varieties(struct variety **varieties);
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * Synthetic fruit catalog generator.
+ *
+ * Writes a yaml stream of randomly generated fruits, for benchmarks.  The
+ * shape of the catalog is configurable:
+ *
+ *    --fruits N          number of fruits (default 1000)
+ *    --varieties MIN-MAX varieties per fruit, uniformly distributed
+ *                        (default 0-4)
+ *    --length MIN-MAX    length of names, uniformly distributed (default 4-12)
+ *    --colors N          number of distinct colors (default 8)
+ *    --documents N       number of documents; the fruits are divided
+ *                        between them (default 1)
+ *    --seed N            random seed (default 1)
+ *
+ * The same options always produce the same output, so generated files can
+ * be compared between runs and between commits.  For example:
+ *
+ *    $ ./generate --fruits 100000 --varieties 2-6 --documents 8 > big.yaml
+ */
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fruit.h"
+#include "output.h"
+#include "writer.h"
+
+#define MAX_LENGTH 64
+
+/* A range of values, chosen uniformly. */
+struct range {
+    size_t min;
+    size_t max;
+};
+
+/* xorshift64* generator, so output does not depend on the C library. */
+static uint64_t seed;
+
+uint64_t
+random64(void)
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 0x2545f4914f6cdd1dULL;
+}
+
+size_t
+random_range(struct range r)
+{
+    return r.min + random64() % (r.max - r.min + 1);
+}
+
+/* Generate a random lower case name in the catalog. */
+const char *
+random_name(struct catalog *c, struct range length)
+{
+    char name[MAX_LENGTH];
+    size_t n = random_range(length);
+
+    for (size_t i = 0; i < n; i++) {
+        name[i] = 'a' + random64() % 26;
+    }
+    return catalog_strndup(c, name, n);
+}
+
+/* Parse N or MIN-MAX. */
+int
+parse_range(const char *s, struct range *r, size_t limit)
+{
+    char *end;
+
+    r->min = strtoul(s, &end, 10);
+    r->max = r->min;
+    if (*end == '-') {
+        r->max = strtoul(end + 1, &end, 10);
+    }
+    return end != s && *end == '\0' && r->min <= r->max && r->max <= limit;
+}
+
+void
+usage(void)
+{
+    fprintf(stderr, "usage: generate [--fruits N] [--varieties MIN-MAX] [--length MIN-MAX] [--colors N]\n"
+                    "                [--documents N] [--seed N]\n");
+    exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct catalog catalog;
+    struct catalog palette;
+    struct output out;
+    struct range varieties = {0, 4};
+    struct range length = {4, 12};
+    struct range one;
+    size_t fruits = 1000;
+    size_t ncolors = 8;
+    size_t documents = 1;
+    unsigned long long seed_option = 1;
+    const char **colors;
+    int error;
+    struct option options[] = {
+        {"fruits", required_argument, NULL, 'f'},
+        {"varieties", required_argument, NULL, 'v'},
+        {"length", required_argument, NULL, 'l'},
+        {"colors", required_argument, NULL, 'c'},
+        {"documents", required_argument, NULL, 'd'},
+        {"seed", required_argument, NULL, 's'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "f:v:l:c:d:s:", options, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            if (!parse_range(optarg, &one, SIZE_MAX) || one.min != one.max) {
+                usage();
+            }
+            fruits = one.min;
+            break;
+        case 'v':
+            if (!parse_range(optarg, &varieties, 1000)) {
+                usage();
+            }
+            break;
+        case 'l':
+            if (!parse_range(optarg, &length, MAX_LENGTH) || length.min == 0) {
+                usage();
+            }
+            break;
+        case 'c':
+            if (!parse_range(optarg, &one, 100000) || one.min != one.max || one.min == 0) {
+                usage();
+            }
+            ncolors = one.min;
+            break;
+        case 'd':
+            if (!parse_range(optarg, &one, 100000) || one.min != one.max || one.min == 0) {
+                usage();
+            }
+            documents = one.min;
+            break;
+        case 's':
+            seed_option = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc) {
+        usage();
+    }
+
+    /* xorshift needs a nonzero state. */
+    seed = seed_option * 0x9e3779b97f4a7c15ULL + 1;
+    catalog_init(&catalog);
+    catalog_init(&palette);
+    if ((error = output_open_fd(&out, STDOUT_FILENO, 0))) {
+        bail(strerror(error));
+    }
+    colors = bail_alloc(ncolors * sizeof(*colors));
+    for (size_t i = 0; i < ncolors; i++) {
+        colors[i] = random_name(&palette, length);
+    }
+    for (size_t d = 0; d < documents; d++) {
+        /* The remainder is spread over the first documents. */
+        size_t n = fruits / documents + (d < fruits % documents);
+
+        for (size_t i = 0; i < n; i++) {
+            size_t nvarieties = random_range(varieties);
+            const char *name;
+            const char *color;
+
+            for (size_t j = 0; j < nvarieties; j++) {
+                name = random_name(&catalog, length);
+                color = colors[random64() % ncolors];
+                catalog_add_variety(&catalog, name, color, random64() % 2);
+            }
+            name = random_name(&catalog, length);
+            color = colors[random64() % ncolors];
+            catalog_add_fruit(&catalog, name, color, random64() % 1000);
+        }
+        if (!writer_supports(&catalog)) {
+            bail("generated catalog needs quoting");
+        }
+        write_catalog(&catalog, &out);
+        catalog_reset(&catalog);
+    }
+    if ((error = output_close(&out))) {
+        fprintf(stderr, "stdout: %s\n", strerror(error));
+        return EXIT_FAILURE;
+    }
+    bail_free(ALLOC_OTHER, colors);
+    catalog_destroy(&palette);
+    catalog_destroy(&catalog);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,44 @@
+/*
+ * A fast 64-bit hash of a range of bytes.
+ *
+ * It reads eight bytes at a time, so hashing a large file costs about as
+ * much as reading it.  It is not meant to resist deliberate collisions.
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HASH_PRIME1 0x9e3779b185ebca87ULL
+#define HASH_PRIME2 0xc2b2ae3d27d4eb4fULL
+
+static inline uint64_t
+hash_rotate(uint64_t x, int bits)
+{
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static inline uint64_t
+hash_bytes(const unsigned char *p, size_t length)
+{
+    uint64_t h = HASH_PRIME1 ^ length;
+    uint64_t k;
+
+    for (; length >= 8; p += 8, length -= 8) {
+        memcpy(&k, p, 8);
+        h = hash_rotate(h ^ (k * HASH_PRIME2), 31) * HASH_PRIME1;
+    }
+    k = 0;
+    memcpy(&k, p, length);
+    h = hash_rotate(h ^ (k * HASH_PRIME2), 31) * HASH_PRIME1;
+    /* Mix the last bits into all of them. */
+    h ^= h >> 33;
+    h *= HASH_PRIME2;
+    h ^= h >> 29;
+    return h;
+}
+
+#endif
@@ -0,0 +1,327 @@
+/*
+ * Offset indexes for looking up fruits without parsing the whole stream.
+ * The format is described in index.h.
+ *
+ * The index is built from the marks of the events: the start of each fruit's
+ * mapping and the end of it.  A fruit is loaded again by parsing just its
+ * bytes, wrapped in the few bytes it needs to be a document of its own:
+ *
+ *     fruit:                          fruit: [<mapping>]
+ *       - <mapping>
+ *
+ * for an item of a block sequence, indented to its column, and for an item
+ * of a flow sequence.  So a lookup does not depend on the size of the file.
+ * Anchors and aliases between fruits are not supported by lookups, since
+ * the anchor may be outside the fruit.
+ */
+
+#define _GNU_SOURCE
+#include <yaml.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "index.h"
+#include "output.h"
+
+/* The index of a file being built. */
+struct builder {
+    struct index_entry *entries;
+    size_t nentries;
+    size_t size;
+    char *names;
+    size_t names_used;
+    size_t names_size;
+    struct index_entry next;    /* The fruit being parsed. */
+};
+
+/*
+ * Add a fruit to the index, when its mapping ends.  Its length is set by
+ * the caller, which has the end mark.
+ */
+static enum status
+add_entry(struct catalog *c, struct catalog_fruit *f, void *data)
+{
+    struct builder *b = data;
+    size_t length = strlen(f->name);
+
+    if (b->nentries == UINT32_MAX || b->names_used + length + 1 > UINT32_MAX) {
+        fprintf(stderr, "index: too many names\n");
+        return FAILURE;
+    }
+    if (b->nentries == b->size) {
+        b->size = b->size ? b->size * 2 : 1024;
+        b->entries = bail_realloc(b->entries, b->size * sizeof(*b->entries));
+    }
+    while (b->names_used + length + 1 > b->names_size) {
+        b->names_size = b->names_size ? b->names_size * 2 : 65536;
+        b->names = bail_realloc(b->names, b->names_size);
+    }
+    b->next.name = b->names_used;
+    b->next.name_length = length;
+    memcpy(b->names + b->names_used, f->name, length + 1);
+    b->names_used += length + 1;
+    b->entries[b->nentries++] = b->next;
+    return SUCCESS;
+}
+
+static int
+compare_entries(const void *a, const void *b, void *names)
+{
+    const struct index_entry *x = a;
+    const struct index_entry *y = b;
+    int order = strcmp((char *)names + x->name, (char *)names + y->name);
+
+    if (order == 0) {
+        order = x->offset < y->offset ? -1 : x->offset > y->offset;
+    }
+    return order;
+}
+
+static uint64_t
+mtime_ns(const struct stat *st)
+{
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/* Parse a stream, recording the range of each fruit. */
+static int
+build_entries(struct builder *b, const unsigned char *data, size_t size)
+{
+    struct parser_state s;
+    struct mark_cursor marks;
+    yaml_parser_t parser;
+    enum status status;
+
+    parser_state_init(&s, add_entry, b);
+    if (!mark_cursor_init(&marks, data, size)) {
+        fprintf(s.log, "index: only UTF-8 files can be indexed\n");
+        parser_state_destroy(&s);
+        return FAILURE;
+    }
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, data, size);
+    do {
+        yaml_event_t event;
+        size_t n = b->nentries;
+
+        status = yaml_parser_parse(&parser, &event);
+        if (status == FAILURE) {
+            fprintf(s.log, "yaml_parser_parse error\n");
+            break;
+        }
+        if (event.type == YAML_MAPPING_START_EVENT && s.state == STATE_FVALUES) {
+            b->next.offset = mark_offset(&marks, event.start_mark.index);
+            b->next.column = event.start_mark.column;
+            if (event.start_mark.column > UINT16_MAX) {
+                fprintf(s.log, "index: fruit at line %zu is indented too far\n", event.start_mark.line + 1);
+                status = FAILURE;
+            }
+        }
+        if (status == SUCCESS && (status = consume_event(&s, &event)) == FAILURE) {
+            fprintf(s.log, "consume_event error\n");
+        }
+        if (b->nentries > n) {
+            size_t length = mark_offset(&marks, event.end_mark.index) - b->entries[n].offset;
+
+            if (length > UINT32_MAX) {
+                fprintf(s.log, "index: fruit at line %zu is too long\n", event.start_mark.line + 1);
+                status = FAILURE;
+            }
+            b->entries[n].length = length;
+        }
+        if (event.type == YAML_SEQUENCE_START_EVENT && s.state == STATE_FVALUES) {
+            b->next.flags = event.data.sequence_start.style == YAML_FLOW_SEQUENCE_STYLE ? INDEX_FLOW : 0;
+        }
+        yaml_event_delete(&event);
+    } while (status == SUCCESS && s.state != STATE_STOP);
+    yaml_parser_delete(&parser);
+    parser_state_destroy(&s);
+    return status;
+}
+
+/*
+ * Build the index of a yaml file, whose contents are given, and write it to
+ * index_path.  Returns 0 on success, an errno value if the index cannot be
+ * written, or -1 if the yaml fails to load, after reporting the errors.
+ */
+int
+index_build(const char *path, const unsigned char *data, size_t size, const char *index_path)
+{
+    struct builder b;
+    struct index_header header;
+    struct output out;
+    struct stat st;
+    int error;
+
+    memset(&b, 0, sizeof(b));
+    if (stat(path, &st) < 0) {
+        return errno;
+    }
+    if (build_entries(&b, data, size) == FAILURE) {
+        error = -1;
+        goto done;
+    }
+    qsort_r(b.entries, b.nentries, sizeof(*b.entries), compare_entries, b.names);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.nentries = b.nentries;
+    header.source_size = st.st_size;
+    header.source_mtime = mtime_ns(&st);
+    header.names_size = b.names_used;
+    if ((error = output_open(&out, index_path, 0,
+                             sizeof(header) + b.nentries * sizeof(*b.entries) + b.names_used, 0))) {
+        goto done;
+    }
+    output_write(&out, &header, sizeof(header));
+    output_write(&out, b.entries, b.nentries * sizeof(*b.entries));
+    output_write(&out, b.names, b.names_used);
+    error = output_close(&out);
+
+done:
+    bail_free(ALLOC_OTHER, b.entries);
+    bail_free(ALLOC_OTHER, b.names);
+    return error;
+}
+
+/*
+ * Open the index of a yaml file.  Returns 0 on success, EINVAL if the index
+ * is not valid, ESTALE if the yaml file has changed since it was built, or
+ * another errno value.
+ */
+int
+index_open(struct fruit_index *idx, const char *index_path, const char *path)
+{
+    const struct index_header *h;
+    struct stat st;
+    int error;
+
+    memset(idx, 0, sizeof(*idx));
+    if ((error = input_map(&idx->input, index_path))) {
+        return error;
+    }
+    h = (const struct index_header *)idx->input.data;
+    if (idx->input.size < sizeof(*h) || memcmp(h->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        h->version != INDEX_VERSION ||
+        idx->input.size != sizeof(*h) + h->nentries * sizeof(struct index_entry) + h->names_size ||
+        (h->names_size > 0 && idx->input.data[idx->input.size - 1] != '\0')) {
+        error = EINVAL;
+        goto fail;
+    }
+    if (stat(path, &st) < 0) {
+        error = errno;
+        goto fail;
+    }
+    if (h->source_size != (uint64_t)st.st_size || h->source_mtime != mtime_ns(&st)) {
+        error = ESTALE;
+        goto fail;
+    }
+    idx->header = h;
+    idx->entries = (const struct index_entry *)(h + 1);
+    idx->nentries = h->nentries;
+    idx->names = (const char *)(idx->entries + idx->nentries);
+    return 0;
+
+fail:
+    input_close(&idx->input);
+    return error;
+}
+
+static const char *
+entry_name(const struct fruit_index *idx, const struct index_entry *e)
+{
+    return e->name < idx->header->names_size ? idx->names + e->name : "";
+}
+
+/*
+ * Find the fruits with a name.  Returns the number of them, and sets first
+ * to the first one; they are in the order of the file.
+ */
+size_t
+index_find(const struct fruit_index *idx, const char *name, const struct index_entry **first)
+{
+    size_t low = 0;
+    size_t high = idx->nentries;
+    size_t n = 0;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (strcmp(entry_name(idx, &idx->entries[middle]), name) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *first = &idx->entries[low];
+    while (low + n < idx->nentries && strcmp(entry_name(idx, &idx->entries[low + n]), name) == 0) {
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Load the fruit of an index entry into the catalog of a parser state,
+ * given the contents of the yaml file.
+ */
+int
+index_load(struct parser_state *s, const struct fruit_index *idx, const struct index_entry *e,
+           const unsigned char *data, size_t size)
+{
+    static const char block[] = "fruit:\n";
+    static const char flow[] = "fruit: [";
+    yaml_parser_t parser;
+    size_t nfruits = s->catalog.nfruits;
+    unsigned char *buffer;
+    size_t n;
+    enum status status;
+
+    if (e->offset > size || e->length > size - e->offset) {
+        fprintf(s->log, "index: entry out of range\n");
+        return FAILURE;
+    }
+    buffer = bail_alloc(sizeof(block) + e->column + e->length + 2);
+    if (e->flags & INDEX_FLOW) {
+        memcpy(buffer, flow, sizeof(flow) - 1);
+        n = sizeof(flow) - 1;
+    } else {
+        /* Put the mapping at its column, so its other lines line up. */
+        memcpy(buffer, block, sizeof(block) - 1);
+        n = sizeof(block) - 1;
+        if (e->column >= 2) {
+            memset(buffer + n, ' ', e->column - 2);
+            n += e->column - 2;
+        }
+        buffer[n++] = '-';
+        buffer[n++] = ' ';
+    }
+    memcpy(buffer + n, data + e->offset, e->length);
+    n += e->length;
+    if (e->flags & INDEX_FLOW) {
+        buffer[n++] = ']';
+    }
+
+    s->state = STATE_START;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, buffer, n);
+    status = load_events(s, &parser);
+    yaml_parser_delete(&parser);
+    bail_free(ALLOC_OTHER, buffer);
+    if (status == SUCCESS && (s->catalog.nfruits != nfruits + 1 ||
+                              strcmp(s->catalog.fruits[nfruits].name, entry_name(idx, e)) != 0)) {
+        fprintf(s->log, "index: entry does not match the file\n");
+        status = FAILURE;
+    }
+    return status;
+}
+
+void
+index_close(struct fruit_index *idx)
+{
+    input_close(&idx->input);
+    memset(idx, 0, sizeof(*idx));
+}
@@ -0,0 +1,63 @@
+/*
+ * Offset indexes for looking up fruits without parsing the whole stream.
+ *
+ * An index is a sidecar file which records, for each fruit of a yaml file,
+ * its name and the range of bytes of its mapping.  It starts with a header
+ * (struct index_header), followed by the entries sorted by name, and then
+ * the names, each with a terminating NUL.  The header records the size and
+ * modification time of the yaml file, so a stale index is detected.  All
+ * numbers are in host byte order.
+ *
+ * Lookups are done in place in the mapped index, with a binary search.
+ */
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "input.h"
+#include "load.h"
+
+#define INDEX_MAGIC "YAMLIDX"
+#define INDEX_VERSION 2      /* 1 had character offsets. */
+#define INDEX_SUFFIX ".idx"
+
+/* Entry flags. */
+#define INDEX_FLOW 0x01     /* The fruit is an item of a flow sequence. */
+
+struct index_header {
+    char magic[8];          /* INDEX_MAGIC, NUL-padded. */
+    uint32_t version;
+    uint32_t nentries;
+    uint64_t source_size;   /* Size of the yaml file. */
+    uint64_t source_mtime;  /* Modification time of the yaml file, in ns. */
+    uint64_t names_size;    /* Bytes of names. */
+};
+
+struct index_entry {
+    uint64_t offset;        /* Start of the fruit's mapping, in bytes. */
+    uint32_t length;        /* Length of the mapping. */
+    uint32_t name;          /* Offset of the name. */
+    uint32_t name_length;
+    uint16_t column;        /* Column of the mapping. */
+    uint16_t flags;
+};
+
+struct fruit_index {
+    const struct index_header *header;
+    const struct index_entry *entries;
+    size_t nentries;
+    const char *names;
+    struct input input;     /* The mapped index file. */
+};
+
+int index_build(const char *path, const unsigned char *data, size_t size, const char *index_path);
+int index_open(struct fruit_index *idx, const char *index_path, const char *path);
+size_t index_find(const struct fruit_index *idx, const char *name, const struct index_entry **first);
+int index_load(struct parser_state *s, const struct fruit_index *idx, const struct index_entry *e,
+               const unsigned char *data, size_t size);
+void index_close(struct fruit_index *idx);
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * Input files, mapped or read into memory.
+ *
+ * Reading a large file through stdio copies every byte from the page cache
+ * into the stdio buffer and again into the libyaml buffer.  Mapping the file
+ * lets libyaml read the page cache directly with
+ * yaml_parser_set_input_string().  The kernel is told the file will be read
+ * sequentially, so it reads ahead aggressively and drops pages behind us.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "input.h"
+
+/*
+ * Map a file for reading, or read it if it is not a regular file.  Returns 0
+ * on success or an errno value.
+ */
+int
+input_map(struct input *in, const char *path)
+{
+    struct stat st;
+    int fd;
+    int error = 0;
+
+    memset(in, 0, sizeof(*in));
+    in->data = (const unsigned char *)"";
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+    if (fstat(fd, &st) < 0) {
+        error = errno;
+        goto done;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        /* Pipes, FIFOs and devices such as /dev/stdin cannot be mapped. */
+        FILE *fp = fdopen(fd, "r");
+
+        if (!fp) {
+            error = errno;
+            goto done;
+        }
+        error = input_read(in, fp);
+        fclose(fp);
+        return error;
+    }
+    if (st.st_size == 0) {
+        goto done;
+    }
+    in->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (in->map == MAP_FAILED) {
+        in->map = NULL;
+        error = errno;
+        goto done;
+    }
+    in->data = in->map;
+    in->size = st.st_size;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    madvise(in->map, in->size, MADV_SEQUENTIAL);
+
+done:
+    close(fd);
+    return error;
+}
+
+/*
+ * Read all of a stream, such as a pipe, into memory for the modes which need
+ * the whole input at once.  Returns 0 on success or an errno value.
+ */
+int
+input_read(struct input *in, FILE *fp)
+{
+    size_t size = 1024 * 1024;
+    size_t n;
+    unsigned char *buffer = NULL;
+    unsigned char *p;
+
+    memset(in, 0, sizeof(*in));
+    for (;;) {
+        p = realloc(buffer, size);
+        if (!p) {
+            free(buffer);
+            return ENOMEM;
+        }
+        buffer = p;
+        n = fread(buffer + in->size, 1, size - in->size, fp);
+        in->size += n;
+        if (in->size < size) {
+            break;
+        }
+        size *= 2;
+    }
+    in->buffer = buffer;
+    in->data = buffer;
+    if (ferror(fp)) {
+        input_close(in);
+        return EIO;
+    }
+    return 0;
+}
+
+void
+input_close(struct input *in)
+{
+    if (in->map) {
+        munmap(in->map, in->size);
+    }
+    free(in->buffer);
+    memset(in, 0, sizeof(*in));
+}
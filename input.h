@@ -0,0 +1,22 @@
+/*
+ * Input files, mapped or read into memory.
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+struct input {
+    const unsigned char *data;  /* File contents. */
+    size_t size;                /* File size in bytes. */
+    void *map;                  /* Mapping, or NULL if the file is empty. */
+    void *buffer;               /* Buffer, if the data was read. */
+};
+
+int input_map(struct input *in, const char *path);
+int input_read(struct input *in, FILE *fp);
+void input_close(struct input *in);
+
+#endif
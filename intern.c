@@ -0,0 +1,124 @@
+/*
+ * String interning table.
+ *
+ * An open addressing hash table with linear probing.  The strings themselves
+ * are copied into an arena, so the table only holds pointers, and it is
+ * released along with the arena.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+#include "fruit.h"
+
+#define INTERN_INITIAL_SIZE 64
+
+/* FNV-1a hash of a string. */
+static uint32_t
+intern_hash(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void
+intern_init(struct intern *t, struct arena *arena)
+{
+    memset(t, 0, sizeof(*t));
+    t->arena = arena;
+}
+
+/* Double the table size and reinsert the entries. */
+static void
+intern_grow(struct intern *t)
+{
+    struct intern_entry *old = t->table;
+    size_t old_size = t->size;
+
+    t->size = old_size ? old_size * 2 : INTERN_INITIAL_SIZE;
+    t->table = bail_alloc_as(ALLOC_INTERN, t->size * sizeof(*t->table));
+    for (size_t i = 0; i < old_size; i++) {
+        if (old[i].string) {
+            size_t j = old[i].hash & (t->size - 1);
+            while (t->table[j].string) {
+                j = (j + 1) & (t->size - 1);
+            }
+            t->table[j] = old[i];
+        }
+    }
+    bail_free(ALLOC_INTERN, old);
+}
+
+/* Get the interned copy of a string, adding it if it is not present. */
+const char *
+intern_string(struct intern *t, const char *s, size_t len)
+{
+    uint32_t hash = intern_hash(s, len);
+    struct intern_entry *e;
+    size_t i;
+
+    t->lookups++;
+    if (t->count * 4 >= t->size * 3) {
+        intern_grow(t);
+    }
+    for (i = hash & (t->size - 1); t->table[i].string; i = (i + 1) & (t->size - 1)) {
+        e = &t->table[i];
+        if (e->hash == hash && e->length == len && memcmp(e->string, s, len) == 0) {
+            t->hits++;
+            t->saved += len + 1;
+            return e->string;
+        }
+    }
+    e = &t->table[i];
+    e->string = arena_strndup(t->arena, s, len);
+    e->hash = hash;
+    e->length = len;
+    t->count++;
+    t->bytes += len + 1;
+    return e->string;
+}
+
+/* Find the interned copy of a string, or NULL if it has not been interned. */
+const char *
+intern_lookup(const struct intern *t, const char *s, size_t len)
+{
+    uint32_t hash = intern_hash(s, len);
+    const struct intern_entry *e;
+
+    if (!t->size) {
+        return NULL;
+    }
+    for (size_t i = hash & (t->size - 1); t->table[i].string; i = (i + 1) & (t->size - 1)) {
+        e = &t->table[i];
+        if (e->hash == hash && e->length == len && memcmp(e->string, s, len) == 0) {
+            return e->string;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Forget all the strings, for example when the arena is reset.  The
+ * statistics are kept, so they cover every use of the table.
+ */
+void
+intern_reset(struct intern *t)
+{
+    if (t->table) {
+        memset(t->table, 0, t->size * sizeof(*t->table));
+    }
+    t->count = 0;
+}
+
+void
+intern_destroy(struct intern *t)
+{
+    bail_free(ALLOC_INTERN, t->table);
+    intern_init(t, t->arena);
+}
@@ -0,0 +1,39 @@
+/*
+ * String interning table.
+ *
+ * Keeps one immutable copy of each distinct string, so repeated values share
+ * storage and interned strings can be compared by pointer.
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+struct intern_entry {
+    const char *string;       /* Interned copy, NULL if the slot is free. */
+    uint32_t hash;
+    uint32_t length;
+};
+
+struct intern {
+    struct intern_entry *table;
+    size_t size;              /* Number of slots, a power of two. */
+    size_t count;             /* Number of slots used. */
+    struct arena *arena;      /* Storage for the strings. */
+    unsigned long lookups;    /* Calls to intern_string(). */
+    unsigned long hits;       /* Lookups which found an existing string. */
+    unsigned long bytes;      /* Bytes of unique strings stored. */
+    unsigned long saved;      /* Bytes not stored again due to hits. */
+};
+
+void intern_init(struct intern *t, struct arena *arena);
+const char *intern_string(struct intern *t, const char *s, size_t len);
+const char *intern_lookup(const struct intern *t, const char *s, size_t len);
+void intern_reset(struct intern *t);
+void intern_destroy(struct intern *t);
+
+#endif
@@ -0,0 +1,645 @@
+/*
+ * Load fruit yaml into a catalog.
+ *
+ * The grammar is described once in the SCHEMA() table below, and the
+ * transition table and key lookup which drive consume_event() are built
+ * from it.
+ *
+ * Completed fruits are either kept in the catalog of the parser state, or,
+ * when a callback is registered, handed to the callback as soon as they end
+ * and then released, so the memory used stays flat however long the stream
+ * is.
+ */
+#include <yaml.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "load.h"
+#include "scalar.h"
+#include "tape.h"
+#include "trace.h"
+
+/* The kinds of mappings in our grammar. */
+enum object {
+    OBJECT_DOCUMENT,
+    OBJECT_FRUIT,
+    OBJECT_VARIETY,
+    OBJECT_COUNT
+};
+
+/* The types of field values. */
+enum field_type {
+    FIELD_STRING,   /* string, copied */
+    FIELD_INTERN,   /* string, interned */
+    FIELD_INTEGER,  /* integer */
+    FIELD_BOOLEAN,  /* yaml boolean */
+    FIELD_LIST      /* sequence of objects */
+};
+
+/*
+ * The grammar, described once.  Each field is listed with the mapping it
+ * appears in, its key, the type of its value, and where the value is stored
+ * in the parser state.  FIELD_LIST values are not stored; instead the last
+ * column is the state which starts the list.  To add a field, add a line
+ * here and a member to the catalog structs.
+ */
+#define SCHEMA(X) \
+    X(OBJECT_DOCUMENT, "fruit",     FIELD_LIST,    0,                                STATE_FLIST) \
+    X(OBJECT_FRUIT,    "name",      FIELD_STRING,  offsetof(struct catalog_fruit, name),    0) \
+    X(OBJECT_FRUIT,    "color",     FIELD_INTERN,  offsetof(struct catalog_fruit, color),   0) \
+    X(OBJECT_FRUIT,    "count",     FIELD_INTEGER, offsetof(struct catalog_fruit, count),   0) \
+    X(OBJECT_FRUIT,    "varieties", FIELD_LIST,    0,                                STATE_VLIST) \
+    X(OBJECT_VARIETY,  "name",      FIELD_INTERN,  offsetof(struct catalog_variety, name),  0) \
+    X(OBJECT_VARIETY,  "color",     FIELD_INTERN,  offsetof(struct catalog_variety, color), 0) \
+    X(OBJECT_VARIETY,  "seedless",  FIELD_BOOLEAN, offsetof(struct catalog_variety, seedless), 0)
+
+struct field {
+    enum object object;
+    const char *key;
+    size_t length;          /* Length of key. */
+    enum field_type type;
+    size_t offset;          /* Offset of the value in the object data. */
+    enum state list;        /* First state of a FIELD_LIST value. */
+};
+
+#define FIELD(object, key, type, offset, list) \
+    {object, key, sizeof(key) - 1, type, offset, list},
+static const struct field fields[] = { SCHEMA(FIELD) };
+#undef FIELD
+
+#define NFIELDS (sizeof(fields) / sizeof(fields[0]))
+
+/*
+ * The states of each kind of mapping.  A mapping appears in a list, which
+ * returns to the key state of its parent mapping when it ends.  The fruit
+ * list returns to its own state instead, where only the end of the document
+ * mapping may follow.
+ */
+struct object_states {
+    enum state list;        /* Expecting the start of the list. */
+    enum state items;       /* Expecting a mapping or the end of the list. */
+    enum state key;         /* Expecting a key or the end of the mapping. */
+    enum state value;       /* Expecting a field value. */
+    enum state parent;      /* State after the list. */
+};
+
+static const struct object_states objects[OBJECT_COUNT] = {
+    [OBJECT_FRUIT]    = {STATE_FLIST, STATE_FVALUES, STATE_FKEY, STATE_FFIELD, STATE_FLIST},
+    [OBJECT_VARIETY]  = {STATE_VLIST, STATE_VVALUES, STATE_VKEY, STATE_VFIELD, STATE_FKEY},
+};
+
+/* What to do on a transition. */
+enum action {
+    ACTION_ERROR,   /* unexpected event */
+    ACTION_NONE,    /* just change state */
+    ACTION_KEY,     /* look up the field for a key */
+    ACTION_VALUE,   /* store the value of the current field */
+    ACTION_END,     /* add the completed object */
+    ACTION_SKIP     /* skip a value which is not needed */
+};
+
+struct transition {
+    unsigned char state;    /* Next state. */
+    unsigned char action;
+    unsigned char object;   /* Object of the action. */
+};
+
+#define NEVENTS (YAML_MAPPING_END_EVENT + 1)
+
+/* Dense transition table, indexed by state and event type. */
+static struct transition transitions[STATE_COUNT][NEVENTS];
+
+/*
+ * Perfect hash of the keys of each object, indexed by a hash of the key
+ * length and its first and last bytes.  Each slot holds a field index plus
+ * one, or zero if no key hashes to it.
+ */
+#define KEYMAP_BITS 4
+#define KEYMAP_SIZE (1 << KEYMAP_BITS)
+
+struct keymap {
+    uint32_t seed;
+    unsigned char slots[KEYMAP_SIZE];
+};
+
+static struct keymap keymaps[OBJECT_COUNT];
+
+static inline unsigned
+key_slot(uint32_t seed, const char *key, size_t length)
+{
+    uint32_t k = length ? (uint32_t)length << 16 | (unsigned char)key[0] << 8 | (unsigned char)key[length - 1] : 0;
+    return (k * seed) >> (32 - KEYMAP_BITS);
+}
+
+/* Find the field for a key in an object, or NULL if there is none. */
+static inline const struct field *
+find_field(enum object object, const char *key, size_t length)
+{
+    const struct keymap *m = &keymaps[object];
+    unsigned i = m->slots[key_slot(m->seed, key, length)];
+    const struct field *f;
+
+    if (!i) {
+        return NULL;
+    }
+    f = &fields[i - 1];
+    if (f->length != length || memcmp(f->key, key, length) != 0) {
+        return NULL;
+    }
+    return f;
+}
+
+static void
+set_transition(enum state from, yaml_event_type_t event, enum state to,
+               enum action action, enum object object)
+{
+    transitions[from][event].state = to;
+    transitions[from][event].action = action;
+    transitions[from][event].object = object;
+}
+
+/*
+ * Build the transition table and key maps from the schema.
+ */
+static void
+init_schema(void)
+{
+    /* Stream and document structure. */
+    set_transition(STATE_START, YAML_STREAM_START_EVENT, STATE_STREAM, ACTION_NONE, 0);
+    set_transition(STATE_STREAM, YAML_DOCUMENT_START_EVENT, STATE_DOCUMENT, ACTION_NONE, 0);
+    set_transition(STATE_STREAM, YAML_STREAM_END_EVENT, STATE_STOP, ACTION_NONE, 0);
+    set_transition(STATE_DOCUMENT, YAML_MAPPING_START_EVENT, STATE_SECTION, ACTION_NONE, 0);
+    set_transition(STATE_DOCUMENT, YAML_DOCUMENT_END_EVENT, STATE_STREAM, ACTION_NONE, 0);
+    set_transition(STATE_SECTION, YAML_SCALAR_EVENT, STATE_SECTION, ACTION_KEY, OBJECT_DOCUMENT);
+    set_transition(STATE_SECTION, YAML_DOCUMENT_END_EVENT, STATE_STREAM, ACTION_NONE, 0);
+    /* The document has the one fruit list, so it ends after the list. */
+    set_transition(STATE_FLIST, YAML_MAPPING_END_EVENT, STATE_SECTION, ACTION_NONE, 0);
+    for (int e = 0; e < NEVENTS; e++) {
+        set_transition(STATE_STOP, e, STATE_STOP, ACTION_NONE, 0);
+        set_transition(STATE_SKIP, e, STATE_SKIP, ACTION_SKIP, OBJECT_FRUIT);
+    }
+
+    /* Lists of mappings. */
+    for (enum object o = OBJECT_FRUIT; o < OBJECT_COUNT; o++) {
+        const struct object_states *s = &objects[o];
+
+        set_transition(s->list, YAML_SEQUENCE_START_EVENT, s->items, ACTION_NONE, o);
+        set_transition(s->items, YAML_MAPPING_START_EVENT, s->key, ACTION_NONE, o);
+        set_transition(s->items, YAML_SEQUENCE_END_EVENT, s->parent, ACTION_NONE, o);
+        set_transition(s->key, YAML_SCALAR_EVENT, s->value, ACTION_KEY, o);
+        set_transition(s->key, YAML_MAPPING_END_EVENT, s->items, ACTION_END, o);
+        set_transition(s->value, YAML_SCALAR_EVENT, s->key, ACTION_VALUE, o);
+    }
+
+    /* Find a seed for each object which gives each key its own slot. */
+    for (enum object o = 0; o < OBJECT_COUNT; o++) {
+        struct keymap *m = &keymaps[o];
+        bool collision;
+
+        m->seed = 0x9e3779b1;
+        do {
+            collision = false;
+            memset(m->slots, 0, sizeof(m->slots));
+            for (size_t i = 0; i < NFIELDS && !collision; i++) {
+                unsigned slot = key_slot(m->seed, fields[i].key, fields[i].length);
+                if (fields[i].object != o) {
+                    continue;
+                }
+                if (m->slots[slot]) {
+                    collision = true;
+                } else {
+                    m->slots[slot] = i + 1;
+                }
+            }
+            m->seed += 2;
+        } while (collision && m->seed != 0x9e3779b1);
+        m->seed -= 2;
+        if (collision) {
+            bail("schema keys cannot be hashed");
+        }
+    }
+}
+
+/*
+ * Store a scalar as the value of the current field.
+ */
+static int
+store_field(struct parser_state *s, enum object object, yaml_event_t *event)
+{
+    const struct field *f = s->field;
+    char *data = object == OBJECT_FRUIT ? (char *)&s->f : (char *)&s->v;
+    char *value = (char *)event->data.scalar.value;
+    size_t length = event->data.scalar.length;
+    const char **string = (const char **)(data + f->offset);
+
+    switch (f->type) {
+    case FIELD_STRING:
+    case FIELD_INTERN:
+        if (*string) {
+            fprintf(s->log, "Warning: duplicate '%s' key.\n", f->key);
+        }
+        if (f->type == FIELD_STRING) {
+            *string = catalog_strndup(&s->catalog, value, length);
+        } else {
+            *string = catalog_intern(&s->catalog, value, length);
+        }
+        break;
+    case FIELD_INTEGER:
+        if (scalar_to_int64(value, length, (int64_t *)(data + f->offset))) {
+            fprintf(s->log, "Invalid integer string value: %s\n", value);
+            return FAILURE;
+        }
+        break;
+    case FIELD_BOOLEAN:
+        if (scalar_to_boolean(value, length, (bool *)(data + f->offset))) {
+            fprintf(s->log, "Invalid boolean string value: %s\n", value);
+            return FAILURE;
+        }
+        break;
+    case FIELD_LIST:
+        break;
+    }
+    return SUCCESS;
+}
+
+/*
+ * Compare a value of the current fruit with the filter.  Returns false if
+ * the fruit cannot match, so the value need not be stored.
+ */
+static bool
+filter_value(struct parser_state *s, yaml_event_t *event)
+{
+    struct filter *filter = &s->filter;
+    const char *value = (const char *)event->data.scalar.value;
+    size_t length = event->data.scalar.length;
+    int64_t number;
+
+    if (s->field == filter->field) {
+        if (filter->field->type == FIELD_INTEGER) {
+            filter->verdict = !scalar_to_int64(value, length, &number) && number == filter->number ?
+                              VERDICT_MATCH : VERDICT_REJECT;
+        } else {
+            filter->verdict = length == filter->length && memcmp(value, filter->value, length) == 0 ?
+                              VERDICT_MATCH : VERDICT_REJECT;
+        }
+    }
+    return filter->verdict != VERDICT_REJECT;
+}
+
+/*
+ * Drop the current fruit, which did not match the filter, with the
+ * varieties it has added.
+ */
+static void
+drop_fruit(struct parser_state *s)
+{
+    s->catalog.nvarieties = s->catalog.claimed;
+    memset(&s->f, 0, sizeof(s->f));
+    s->filter.dropped++;
+}
+
+/*
+ * Add a completed object to the catalog, and pass completed fruits to the
+ * callback.
+ */
+static int
+end_object(struct parser_state *s, enum object object)
+{
+    enum status status = SUCCESS;
+    struct catalog_fruit *f;
+    size_t fruit;
+
+    switch (object) {
+    case OBJECT_FRUIT:
+        if (s->filter.field && s->filter.verdict != VERDICT_MATCH) {
+            drop_fruit(s);
+            s->filter.verdict = VERDICT_UNKNOWN;
+            break;
+        }
+        s->filter.verdict = VERDICT_UNKNOWN;
+        s->filter.kept++;
+        if (!(fruit = catalog_add_fruit(&s->catalog, s->f.name, s->f.color, s->f.count))) {
+            fprintf(s->log, "Duplicate name in fruit: %s\n", s->f.name ? s->f.name : "");
+            memset(&s->f, 0, sizeof(s->f));
+            status = FAILURE;
+            break;
+        }
+        /* A duplicate may have updated an earlier fruit rather than added one. */
+        f = &s->catalog.fruits[fruit - 1];
+        f->unparsed = s->f.unparsed;
+        memset(&s->f, 0, sizeof(s->f));
+        TRACE_FRUIT(s, f->nvarieties);
+        if (s->callback) {
+            status = s->callback(&s->catalog, f, s->callback_data);
+            catalog_reset(&s->catalog);
+        }
+        break;
+    case OBJECT_VARIETY:
+        catalog_add_variety(&s->catalog, s->v.name, s->v.color, s->v.seedless);
+        memset(&s->v, 0, sizeof(s->v));
+        break;
+    default:
+        break;
+    }
+    return status;
+}
+
+/*
+ * Handle an event in the current state.  The transitions are looked up in
+ * the table built by init_schema().
+ */
+static inline int
+handle_event(struct parser_state *s, yaml_event_t *event)
+{
+    const struct transition *t;
+    char *value;
+
+    t = &transitions[s->state][event->type];
+    switch (t->action) {
+    case ACTION_ERROR:
+        fprintf(s->log, "Unexpected event %d in state %d.\n", event->type, s->state);
+        return FAILURE;
+    case ACTION_NONE:
+        break;
+    case ACTION_KEY:
+        value = (char *)event->data.scalar.value;
+        s->field = find_field(t->object, value, event->data.scalar.length);
+        if (!s->field) {
+            fprintf(s->log, "Unexpected key: %s\n", value);
+            return FAILURE;
+        }
+        if (s->field->type == FIELD_LIST) {
+            /*
+             * The lists of a fruit which does not match are skipped, and so
+             * are all the lists of fruits in a lazy load.
+             */
+            s->state = t->object == OBJECT_FRUIT && (s->filter.verdict == VERDICT_REJECT || s->catalog.source) ?
+                       STATE_SKIP : s->field->list;
+            return SUCCESS;
+        }
+        break;
+    case ACTION_VALUE:
+        if (t->object == OBJECT_FRUIT && s->filter.field && !filter_value(s, event)) {
+            break;
+        }
+        if (store_field(s, t->object, event) == FAILURE) {
+            return FAILURE;
+        }
+        break;
+    case ACTION_END:
+        if (end_object(s, t->object) == FAILURE) {
+            return FAILURE;
+        }
+        if (s->filter.limit && s->filter.kept == s->filter.limit) {
+            /* Enough fruits; read no further. */
+            s->state = STATE_STOP;
+            return SUCCESS;
+        }
+        break;
+    case ACTION_SKIP:
+        /* Count the depth of the value, without looking at it. */
+        if (event->type == YAML_SEQUENCE_START_EVENT || event->type == YAML_MAPPING_START_EVENT) {
+            if (s->depth++ == 0 && s->catalog.source) {
+                s->skip_offset = mark_offset(&s->marks, event->start_mark.index);
+                s->skip_column = event->start_mark.column;
+            }
+        } else if (event->type == YAML_SEQUENCE_END_EVENT || event->type == YAML_MAPPING_END_EVENT) {
+            if (--s->depth == 0 && s->catalog.source && s->filter.verdict != VERDICT_REJECT) {
+                /* Keep the range, to parse it when it is needed. */
+                size_t end = mark_offset(&s->marks, event->end_mark.index);
+
+                s->f.unparsed = catalog_add_range(&s->catalog, s->skip_offset, end - s->skip_offset,
+                                                  s->skip_column);
+            }
+        }
+        if (s->depth == 0) {
+            s->state = objects[t->object].key;
+        }
+        return SUCCESS;
+    }
+    s->state = t->state;
+    return SUCCESS;
+}
+
+/*
+ * Consume yaml events generated by the libyaml parser to
+ * import our data into raw c data structures. Error processing
+ * is keep to a mimimum since this is just an example.
+ */
+int consume_event(struct parser_state *s, yaml_event_t *event)
+{
+    enum state from = s->state;
+    int status = handle_event(s, event);
+
+    TRACE_EVENT(s, event, from);
+    return status;
+}
+
+/*
+ * Initialize a parser state.  Without a callback, the fruits are kept in
+ * s->catalog.  With a callback, each fruit is passed to the callback as soon
+ * as it is complete, and released when the callback returns.  Errors and
+ * warnings are written to s->log, stderr unless changed.
+ */
+void
+parser_state_init(struct parser_state *s, fruit_callback callback, void *data)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+    pthread_once(&once, init_schema);
+    memset(s, 0, sizeof(*s));
+    s->state = STATE_START;
+    s->log = stderr;
+    s->callback = callback;
+    s->callback_data = data;
+    catalog_init(&s->catalog);
+#ifndef NO_TRACE
+    if (tracing) {
+        s->trace = trace_new();
+    }
+#endif
+}
+
+/*
+ * Keep only the fruits matching "key=value", if where is not NULL, and stop
+ * after limit fruits, if it is not 0.  The key is a scalar field of fruits.
+ * The lists of fruits which cannot match are skipped, and their values are
+ * not stored.  Returns FAILURE if the filter is not valid.
+ */
+int
+parser_state_set_filter(struct parser_state *s, const char *where, size_t limit)
+{
+    struct filter *filter = &s->filter;
+    const char *equals;
+
+    memset(filter, 0, sizeof(*filter));
+    filter->limit = limit;
+    if (!where) {
+        return SUCCESS;
+    }
+    equals = strchr(where, '=');
+    if (!equals) {
+        fprintf(s->log, "Filter is not key=value: %s\n", where);
+        return FAILURE;
+    }
+    filter->field = find_field(OBJECT_FRUIT, where, equals - where);
+    if (!filter->field || (filter->field->type != FIELD_STRING && filter->field->type != FIELD_INTERN &&
+                           filter->field->type != FIELD_INTEGER)) {
+        fprintf(s->log, "Cannot filter on key: %.*s\n", (int)(equals - where), where);
+        return FAILURE;
+    }
+    filter->value = equals + 1;
+    filter->length = strlen(filter->value);
+    if (filter->field->type == FIELD_INTEGER &&
+        scalar_to_int64(filter->value, filter->length, &filter->number)) {
+        fprintf(s->log, "Invalid integer string value: %s\n", filter->value);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/*
+ * Parse the varieties of a fruit which a lazy load left unparsed.  Their
+ * range is parsed as a document of its own, indented to its column, and its
+ * events are handled from the variety list state, adding the varieties to
+ * the catalog.
+ */
+static int
+load_range(struct catalog *c, struct catalog_fruit *f)
+{
+    const struct catalog_range *r = &c->ranges[f->unparsed - 1];
+    unsigned char *buffer = bail_alloc(r->column + r->length);
+    struct parser_state s;
+    yaml_parser_t parser;
+    size_t first = c->nvarieties;
+    enum status status;
+
+    memset(buffer, ' ', r->column);
+    memcpy(buffer + r->column, c->source + r->offset, r->length);
+    parser_state_init(&s, NULL, NULL);
+    catalog_destroy(&s.catalog);
+    catalog_move(&s.catalog, c);
+    s.state = objects[OBJECT_VARIETY].list;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, buffer, r->column + r->length);
+    do {
+        yaml_event_t event;
+
+        status = yaml_parser_parse(&parser, &event);
+        if (status == FAILURE) {
+            fprintf(s.log, "yaml_parser_parse error\n");
+            break;
+        }
+        if (event.type != YAML_STREAM_START_EVENT && event.type != YAML_DOCUMENT_START_EVENT) {
+            TRACE_PARSED(&s);
+            status = consume_event(&s, &event);
+        }
+        yaml_event_delete(&event);
+    } while (status == SUCCESS && s.state != objects[OBJECT_VARIETY].parent);
+    yaml_parser_delete(&parser);
+    catalog_move(c, &s.catalog);
+    parser_state_destroy(&s);
+    bail_free(ALLOC_OTHER, buffer);
+    if (status == FAILURE) {
+        c->nvarieties = first;
+        return FAILURE;
+    }
+    f->variety = first;
+    f->nvarieties = c->nvarieties - first;
+    f->unparsed = 0;
+    c->claimed = c->nvarieties;
+    return SUCCESS;
+}
+
+/*
+ * Leave the varieties of fruits unparsed, recording only where they are, so
+ * that they are parsed by catalog_load_varieties() when they are first
+ * accessed.  The source is the input of the parser, as given to
+ * yaml_parser_set_input_string(), and must outlive the catalog.  Returns
+ * FAILURE, leaving the load eager, if the source is not UTF-8.
+ */
+int
+parser_state_set_lazy(struct parser_state *s, const unsigned char *source, size_t size)
+{
+    if (!mark_cursor_init(&s->marks, source, size)) {
+        return FAILURE;
+    }
+    s->catalog.source = source;
+    s->catalog.load_varieties = load_range;
+    return SUCCESS;
+}
+
+/*
+ * Free a parser state, adding its trace counters to the totals.
+ */
+void
+parser_state_destroy(struct parser_state *s)
+{
+    if (s->trace) {
+        trace_merge(s->trace);
+        s->trace = NULL;
+    }
+    catalog_destroy(&s->catalog);
+}
+
+/*
+ * Consume the events of a libyaml parser until the end of the stream, then
+ * drop the varieties left unused by duplicates.
+ */
+int
+load_events(struct parser_state *s, yaml_parser_t *parser)
+{
+    enum status status;
+
+    do {
+        yaml_event_t event;
+
+        status = yaml_parser_parse(parser, &event);
+        if (status == FAILURE) {
+            fprintf(s->log, "yaml_parser_parse error\n");
+            return FAILURE;
+        }
+        TRACE_PARSED(s);
+        status = consume_event(s, &event);
+        yaml_event_delete(&event);
+        if (status == FAILURE) {
+            fprintf(s->log, "consume_event error\n");
+            return FAILURE;
+        }
+    } while (s->state != STATE_STOP);
+    catalog_compact(&s->catalog);
+    return SUCCESS;
+}
+
+/*
+ * Consume the events recorded on a tape until the end of the stream, as
+ * load_events() does.
+ */
+int
+load_tape(struct parser_state *s, struct tape *t)
+{
+    do {
+        yaml_event_t event;
+
+        if (!tape_next(t, &event)) {
+            fprintf(s->log, "tape error: %s\n", t->problem);
+            return FAILURE;
+        }
+        TRACE_PARSED(s);
+        if (consume_event(s, &event) == FAILURE) {
+            if (t->flags & TAPE_MARKS) {
+                fprintf(s->log, "consume_event error at line %zu, column %zu\n",
+                        event.start_mark.line + 1, event.start_mark.column + 1);
+            } else {
+                fprintf(s->log, "consume_event error\n");
+            }
+            return FAILURE;
+        }
+    } while (s->state != STATE_STOP);
+    catalog_compact(&s->catalog);
+    return SUCCESS;
+}
@@ -0,0 +1,102 @@
+/*
+ * Load fruit yaml into a catalog.
+ *
+ * The parser state machine which converts the libyaml events of the fruit
+ * grammar to catalog records.  The grammar is described in parse.c.
+ */
+
+#ifndef LOAD_H
+#define LOAD_H
+
+#include <yaml.h>
+#include <stdio.h>
+
+#include "fruit.h"
+#include "mark.h"
+
+/* yaml_* functions return 1 on success and 0 on failure. */
+enum status {
+    SUCCESS = 1,
+    FAILURE = 0
+};
+
+/* Our example parser states. */
+enum state {
+    STATE_START,    /* start state */
+    STATE_STREAM,   /* start/end stream */
+    STATE_DOCUMENT, /* start/end document */
+    STATE_SECTION,  /* top level */
+
+    STATE_FLIST,    /* fruit list */
+    STATE_FVALUES,  /* fruit key-value pairs */
+    STATE_FKEY,     /* fruit key */
+    STATE_FFIELD,   /* fruit field value */
+
+    STATE_VLIST,    /* varieties list */
+    STATE_VVALUES,  /* variety key-value pairs */
+    STATE_VKEY,     /* variety key */
+    STATE_VFIELD,   /* variety field value */
+
+    STATE_SKIP,     /* value skipped by a filter */
+
+    STATE_STOP,     /* end state */
+    STATE_COUNT
+};
+
+struct field;
+struct parser_state;
+struct tape;
+struct trace;
+
+/*
+ * Called for each fruit as soon as its mapping ends, with the catalog holding
+ * the fruit and its varieties.  Return FAILURE to stop parsing.
+ */
+typedef enum status (*fruit_callback)(struct catalog *c, struct catalog_fruit *f, void *data);
+
+/* Whether the current fruit matches the filter. */
+enum verdict {
+    VERDICT_UNKNOWN,    /* field not seen yet */
+    VERDICT_MATCH,
+    VERDICT_REJECT
+};
+
+/* Which fruits to keep, set with parser_state_set_filter(). */
+struct filter {
+    const struct field *field;  /* Fruit field to compare, or NULL for all. */
+    const char *value;          /* The value it must have. */
+    size_t length;
+    int64_t number;             /* The value of an integer field. */
+    size_t limit;               /* Stop after this many fruits, if not 0. */
+    size_t kept;                /* Fruits kept. */
+    size_t dropped;             /* Fruits which did not match. */
+    enum verdict verdict;       /* The current fruit. */
+};
+
+/* Our application parser state data. */
+struct parser_state {
+    enum state state;      /* The current parse state */
+    struct catalog_fruit f;   /* Fruit data elements. */
+    struct catalog_variety v; /* Variety data elements. */
+    const struct field *field;/* Field of the current value. */
+    struct catalog catalog;   /* Table of 'fruit' and 'variety' objects. */
+    fruit_callback callback;  /* Consumer of completed fruits, if any. */
+    void *callback_data;
+    FILE *log;                /* Where to report errors. */
+    struct trace *trace;      /* Counters, if tracing. */
+    struct filter filter;     /* Which fruits to keep. */
+    size_t depth;             /* Depth in a skipped value. */
+    size_t skip_offset;       /* Where the skipped value starts, in bytes. */
+    size_t skip_column;
+    struct mark_cursor marks; /* Byte offsets of the marks in the source. */
+};
+
+void parser_state_init(struct parser_state *s, fruit_callback callback, void *data);
+int parser_state_set_filter(struct parser_state *s, const char *where, size_t limit);
+int parser_state_set_lazy(struct parser_state *s, const unsigned char *source, size_t size);
+void parser_state_destroy(struct parser_state *s);
+int consume_event(struct parser_state *s, yaml_event_t *event);
+int load_events(struct parser_state *s, yaml_parser_t *parser);
+int load_tape(struct parser_state *s, struct tape *t);
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * Byte offsets of libyaml marks.
+ *
+ * The index of a libyaml mark counts characters, not bytes, from the start
+ * of the input after its byte order mark, if any.  A cursor converts the
+ * mark indexes of one parse of UTF-8 input to byte offsets.  It moves on
+ * from the last index converted, so converting the marks of a parse in
+ * order reads the input once.
+ */
+
+#ifndef MARK_H
+#define MARK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+struct mark_cursor {
+    const unsigned char *data;
+    size_t start;           /* Offset of the first character. */
+    size_t index;           /* Last index converted. */
+    size_t offset;          /* Its byte offset. */
+};
+
+/*
+ * Start converting the marks of a parse of data.  Returns false if the data
+ * is not UTF-8, which libyaml only detects by a UTF-16 byte order mark.
+ */
+static inline bool
+mark_cursor_init(struct mark_cursor *m, const unsigned char *data, size_t size)
+{
+    m->data = data;
+    m->start = size >= 3 && memcmp(data, "\xef\xbb\xbf", 3) == 0 ? 3 : 0;
+    m->index = 0;
+    m->offset = m->start;
+    return !(size >= 2 && ((data[0] == 0xfe && data[1] == 0xff) || (data[0] == 0xff && data[1] == 0xfe)));
+}
+
+/* Get the byte offset of the character at a mark index. */
+static inline size_t
+mark_offset(struct mark_cursor *m, size_t index)
+{
+    if (index < m->index) {
+        m->index = 0;
+        m->offset = m->start;
+    }
+    for (; m->index < index; m->index++) {
+        unsigned char c = m->data[m->offset];
+
+        /* libyaml has checked the sequences, so the lead byte gives the length. */
+        m->offset += c < 0x80 ? 1 : c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+    }
+    return m->offset;
+}
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * Hash index of the fruits and varieties of a catalog by name.
+ *
+ * Two open addressing hash tables with linear probing: one keyed by fruit
+ * name, and one keyed by the index of a fruit and the name of a variety.
+ * The entries hold indexes into the catalog tables rather than the names,
+ * so the names are compared in the catalog.  The entries of varieties which
+ * a duplicate fruit replaces are removed, with the entries after them in
+ * their probe sequence shifted back over the hole.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "names.h"
+#include "hash.h"
+
+#define NAMES_INITIAL_SIZE 64
+
+static uint64_t
+fruit_hash(const char *name)
+{
+    return hash_bytes((const unsigned char *)name, strlen(name));
+}
+
+static uint64_t
+variety_hash(size_t fruit, const char *name)
+{
+    uint64_t h = fruit_hash(name) ^ ((fruit + 1) * HASH_PRIME2);
+
+    return h ^ (h >> 29);
+}
+
+void
+names_init(struct names *n, enum duplicates policy)
+{
+    memset(n, 0, sizeof(*n));
+    n->policy = policy;
+}
+
+/* Double the size of a table and reinsert the entries. */
+static void
+names_grow(struct name_entry **table, size_t *size)
+{
+    struct name_entry *old = *table;
+    size_t old_size = *size;
+
+    *size = old_size ? old_size * 2 : NAMES_INITIAL_SIZE;
+    *table = bail_alloc_as(ALLOC_NAMES, *size * sizeof(**table));
+    for (size_t i = 0; i < old_size; i++) {
+        if (old[i].fruit) {
+            size_t j = old[i].hash & (*size - 1);
+            while ((*table)[j].fruit) {
+                j = (j + 1) & (*size - 1);
+            }
+            (*table)[j] = old[i];
+        }
+    }
+    bail_free(ALLOC_NAMES, old);
+}
+
+/* Find the entry of a fruit name, or the free slot where it would go. */
+static struct name_entry *
+fruit_slot(const struct names *n, const struct catalog *c, const char *name, uint64_t hash)
+{
+    size_t mask = n->fruits_size - 1;
+    size_t i;
+
+    for (i = hash & mask; n->fruits[i].fruit; i = (i + 1) & mask) {
+        const struct name_entry *e = &n->fruits[i];
+
+        if (e->hash == hash && strcmp(c->fruits[e->fruit - 1].name, name) == 0) {
+            break;
+        }
+    }
+    return &n->fruits[i];
+}
+
+/* Find the entry of a variety name of a fruit, or the free slot where it would go. */
+static struct name_entry *
+variety_slot(const struct names *n, const struct catalog *c, size_t fruit, const char *name, uint64_t hash)
+{
+    size_t mask = n->varieties_size - 1;
+    size_t i;
+
+    for (i = hash & mask; n->varieties[i].fruit; i = (i + 1) & mask) {
+        const struct name_entry *e = &n->varieties[i];
+
+        if (e->hash == hash && e->fruit == fruit + 1 && e->variety < c->nvarieties &&
+            strcmp(c->varieties[e->variety].name, name) == 0) {
+            break;
+        }
+    }
+    return &n->varieties[i];
+}
+
+/* Find a fruit by name.  Returns its index plus one, or 0 if there is none. */
+size_t
+names_find_fruit(const struct names *n, const struct catalog *c, const char *name)
+{
+    if (!n->fruits_size) {
+        return 0;
+    }
+    return fruit_slot(n, c, name, fruit_hash(name))->fruit;
+}
+
+/*
+ * Find a variety of the fruit at an index by name.  Returns its index plus
+ * one, or 0 if the fruit has no such variety.
+ */
+size_t
+names_find_variety(const struct names *n, const struct catalog *c, size_t fruit, const char *name)
+{
+    const struct catalog_fruit *f = &c->fruits[fruit];
+    const struct name_entry *e;
+
+    if (!n->varieties_size) {
+        return 0;
+    }
+    e = variety_slot(n, c, fruit, name, variety_hash(fruit, name));
+    if (!e->fruit || e->variety < f->variety || e->variety >= f->variety + f->nvarieties) {
+        return 0;
+    }
+    return e->variety + 1;
+}
+
+/* Find the slot for a variety name of a fruit, growing the table if needed. */
+static struct name_entry *
+variety_insert_slot(struct names *n, const struct catalog *c, size_t fruit, const char *name, uint64_t hash)
+{
+    if ((n->varieties_count + 1) * 4 > n->varieties_size * 3) {
+        names_grow(&n->varieties, &n->varieties_size);
+    }
+    return variety_slot(n, c, fruit, name, hash);
+}
+
+static void
+variety_set(struct names *n, struct name_entry *e, uint64_t hash, size_t fruit, size_t variety)
+{
+    if (!e->fruit) {
+        n->varieties_count++;
+    }
+    e->hash = hash;
+    e->fruit = fruit + 1;
+    e->variety = variety;
+}
+
+/*
+ * Index the varieties not claimed yet by a fruit, as those of the fruit at
+ * an index, which need not be added yet.  A variety with the same name as
+ * an earlier one of them is a duplicate: it is removed from the table, and
+ * unless the policy is to reject duplicates, its values replace those of
+ * the earlier one.  Returns the number of duplicates.
+ */
+size_t
+names_add_varieties(struct names *n, struct catalog *c, size_t fruit)
+{
+    size_t first = c->claimed;
+    size_t end = c->nvarieties;
+    size_t duplicates = 0;
+
+    c->nvarieties = first;
+    for (size_t i = first; i < end; i++) {
+        struct catalog_variety v = c->varieties[i];
+        uint64_t hash = variety_hash(fruit, v.name);
+        struct name_entry *e = variety_insert_slot(n, c, fruit, v.name, hash);
+
+        if (e->fruit && e->variety >= first) {
+            duplicates++;
+            if (n->policy != DUPLICATES_REJECT) {
+                c->varieties[e->variety] = v;
+            }
+            continue;
+        }
+        variety_set(n, e, hash, fruit, c->nvarieties);
+        c->varieties[c->nvarieties++] = v;
+    }
+    n->duplicates += duplicates;
+    return duplicates;
+}
+
+/* Remove the entry at a slot of a table. */
+static void
+names_remove_slot(struct name_entry *table, size_t size, size_t i)
+{
+    size_t mask = size - 1;
+
+    /* Shift back the entries after it which would not be found across the hole. */
+    for (size_t j = (i + 1) & mask; table[j].fruit; j = (j + 1) & mask) {
+        size_t home = table[j].hash & mask;
+
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            table[i] = table[j];
+            i = j;
+        }
+    }
+    table[i].fruit = 0;
+}
+
+/*
+ * Remove the entries of the varieties from first to end of the fruit at an
+ * index, before the fruit lets go of them.
+ */
+void
+names_remove_varieties(struct names *n, const struct catalog *c, size_t fruit, size_t first, size_t end)
+{
+    if (!n->varieties_size) {
+        return;
+    }
+    for (size_t i = first; i < end; i++) {
+        const char *name = c->varieties[i].name;
+        struct name_entry *e = variety_slot(n, c, fruit, name, variety_hash(fruit, name));
+
+        if (e->fruit && e->variety == i) {
+            names_remove_slot(n->varieties, n->varieties_size, e - n->varieties);
+            n->varieties_count--;
+        }
+    }
+}
+
+/* Index the varieties of all the fruits again, after they have moved. */
+void
+names_index_varieties(struct names *n, const struct catalog *c)
+{
+    if (n->varieties) {
+        memset(n->varieties, 0, n->varieties_size * sizeof(*n->varieties));
+    }
+    n->varieties_count = 0;
+    for (size_t i = 0; i < c->nfruits; i++) {
+        const struct catalog_fruit *f = &c->fruits[i];
+
+        for (size_t j = f->variety; j < f->variety + f->nvarieties; j++) {
+            const char *name = c->varieties[j].name;
+            uint64_t hash = variety_hash(i, name);
+
+            variety_set(n, variety_insert_slot(n, c, i, name, hash), hash, i, j);
+        }
+    }
+}
+
+/* Index the name of the fruit at an index, which is not a duplicate. */
+void
+names_add_fruit(struct names *n, const struct catalog *c, size_t fruit)
+{
+    const char *name = c->fruits[fruit].name;
+    uint64_t hash = fruit_hash(name);
+    struct name_entry *e;
+
+    if ((n->fruits_count + 1) * 4 > n->fruits_size * 3) {
+        names_grow(&n->fruits, &n->fruits_size);
+    }
+    e = fruit_slot(n, c, name, hash);
+    if (!e->fruit) {
+        n->fruits_count++;
+    }
+    e->hash = hash;
+    e->fruit = fruit + 1;
+}
+
+/* Forget all the names, when the catalog is reset.  The count of duplicates is kept. */
+void
+names_reset(struct names *n)
+{
+    if (n->fruits) {
+        memset(n->fruits, 0, n->fruits_size * sizeof(*n->fruits));
+    }
+    if (n->varieties) {
+        memset(n->varieties, 0, n->varieties_size * sizeof(*n->varieties));
+    }
+    n->fruits_count = 0;
+    n->varieties_count = 0;
+}
+
+void
+names_destroy(struct names *n)
+{
+    bail_free(ALLOC_NAMES, n->fruits);
+    bail_free(ALLOC_NAMES, n->varieties);
+    names_init(n, n->policy);
+}
+
+/*
+ * Give the catalog a name index with a policy for duplicates.  The fruits
+ * already in the catalog are indexed as they are, the last of several with
+ * the same name being the one found; later fruits are checked for
+ * duplicates as they are added.
+ */
+void
+catalog_set_names(struct catalog *c, enum duplicates policy)
+{
+    if (!c->names) {
+        c->names = bail_alloc_as(ALLOC_NAMES, sizeof(*c->names));
+    }
+    names_destroy(c->names);
+    names_init(c->names, policy);
+    for (size_t i = 0; i < c->nfruits; i++) {
+        names_add_fruit(c->names, c, i);
+    }
+    names_index_varieties(c->names, c);
+}
+
+/* Find a fruit of a catalog with a name index, or NULL if there is none. */
+struct catalog_fruit *
+catalog_find_fruit(const struct catalog *c, const char *name)
+{
+    size_t fruit = names_find_fruit(c->names, c, name);
+
+    return fruit ? &c->fruits[fruit - 1] : NULL;
+}
+
+/* Find a variety of a fruit by name, or NULL if there is none. */
+struct catalog_variety *
+catalog_find_variety(const struct catalog *c, const struct catalog_fruit *f, const char *name)
+{
+    size_t variety = names_find_variety(c->names, c, f - c->fruits, name);
+
+    return variety ? &c->varieties[variety - 1] : NULL;
+}
@@ -0,0 +1,60 @@
+/*
+ * Hash index of the fruits and varieties of a catalog by name.
+ *
+ * Once a catalog has a name index (catalog_set_names()), it is kept up to
+ * date by catalog_add_fruit(), so a fruit can be found by its name, and a
+ * variety by the name of its fruit and its own name, in O(1) time rather
+ * than by walking the tables.  Adding a fruit whose name is already in the
+ * catalog, or a fruit with two varieties of the same name, is a duplicate,
+ * which is handled by the policy of the index.
+ */
+
+#ifndef NAMES_H
+#define NAMES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fruit.h"
+
+enum duplicates {
+    DUPLICATES_REJECT,      /* A duplicate is not added. */
+    DUPLICATES_LAST,        /* A duplicate replaces the earlier fruit or variety. */
+    DUPLICATES_MERGE        /* A duplicate fruit adds its varieties to the earlier one. */
+};
+
+struct name_entry {
+    uint64_t hash;
+    size_t fruit;           /* Index of the fruit plus one, 0 if the slot is free. */
+    size_t variety;         /* Index of the variety, in the variety table. */
+};
+
+struct names {
+    struct name_entry *fruits;      /* Keyed by fruit name. */
+    size_t fruits_size;             /* Number of slots, a power of two. */
+    size_t fruits_count;            /* Number of slots used. */
+    struct name_entry *varieties;   /* Keyed by fruit index and variety name. */
+    size_t varieties_size;
+    size_t varieties_count;
+    enum duplicates policy;
+    unsigned long duplicates;       /* Duplicate fruits and varieties seen. */
+};
+
+void names_init(struct names *n, enum duplicates policy);
+size_t names_find_fruit(const struct names *n, const struct catalog *c, const char *name);
+size_t names_find_variety(const struct names *n, const struct catalog *c, size_t fruit,
+                          const char *name);
+size_t names_add_varieties(struct names *n, struct catalog *c, size_t fruit);
+void names_add_fruit(struct names *n, const struct catalog *c, size_t fruit);
+void names_remove_varieties(struct names *n, const struct catalog *c, size_t fruit, size_t first,
+                            size_t end);
+void names_index_varieties(struct names *n, const struct catalog *c);
+void names_reset(struct names *n);
+void names_destroy(struct names *n);
+
+void catalog_set_names(struct catalog *c, enum duplicates policy);
+struct catalog_fruit *catalog_find_fruit(const struct catalog *c, const char *name);
+struct catalog_variety *catalog_find_variety(const struct catalog *c, const struct catalog_fruit *f,
+                                             const char *name);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * Buffered output to a file descriptor.
+ *
+ * Output is collected in a large aligned buffer and written with write() or
+ * writev(), bypassing stdio.  When data does not fit in the buffer, the
+ * buffer and the data are written together with one writev() call, so large
+ * writes are not copied.
+ *
+ * Files of a known size can be preallocated with fallocate() so they are not
+ * extended block by block, and can be written with O_DIRECT to bypass the
+ * page cache, which keeps a multi-gigabyte export from evicting everything
+ * else.  Direct writes must be whole aligned blocks, so in direct mode the
+ * buffer is only written when it is full, and the unaligned tail of the
+ * file is written at the end after O_DIRECT is turned off.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "output.h"
+
+/* Write all of an i/o vector, which is modified. */
+static int
+write_all(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Start buffered output to an open file descriptor.  Returns 0 on success or
+ * an errno value.
+ */
+int
+output_open_fd(struct output *out, int fd, size_t buffer_size)
+{
+    memset(out, 0, sizeof(*out));
+    out->fd = fd;
+    if (buffer_size == 0) {
+        buffer_size = OUTPUT_BUFFER_SIZE;
+    }
+    out->size = (buffer_size + OUTPUT_ALIGN - 1) & ~(size_t)(OUTPUT_ALIGN - 1);
+    if (posix_memalign((void **)&out->buffer, OUTPUT_ALIGN, out->size)) {
+        return ENOMEM;
+    }
+    return 0;
+}
+
+/*
+ * Create a file for buffered output.  If the expected size is not negative,
+ * space for the file is allocated up front.  If direct is set, the file is
+ * written with O_DIRECT, if the file system supports it.  Returns 0 on
+ * success or an errno value.
+ */
+int
+output_open(struct output *out, const char *path, size_t buffer_size, off_t expected_size, int direct)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    int fd = -1;
+    int error;
+
+    if (direct) {
+        fd = open(path, flags | O_DIRECT, 0666);
+    }
+    if (fd < 0) {
+        direct = 0;
+        fd = open(path, flags, 0666);
+    }
+    if (fd < 0) {
+        return errno;
+    }
+    if (expected_size > 0) {
+        /* Not all file systems can do this; it is only an optimization. */
+        (void)fallocate(fd, 0, 0, expected_size);
+    }
+    if ((error = output_open_fd(out, fd, buffer_size))) {
+        close(fd);
+        return error;
+    }
+    out->direct = direct;
+    out->close = 1;
+    return 0;
+}
+
+/*
+ * Write data through the buffer.  Returns 0 on success, or the errno value of
+ * this or an earlier failure.
+ */
+int
+output_write(struct output *out, const void *data, size_t size)
+{
+    const char *p = data;
+
+    if (out->error) {
+        return out->error;
+    }
+    if (!out->direct) {
+        if (out->used + size <= out->size) {
+            memcpy(out->buffer + out->used, p, size);
+            out->used += size;
+        } else {
+            struct iovec iov[2] = {
+                {out->buffer, out->used},
+                {(void *)p, size},
+            };
+            out->error = write_all(out->fd, iov, 2);
+            out->used = 0;
+        }
+        return out->error;
+    }
+    while (size > 0 && !out->error) {
+        size_t n = out->size - out->used;
+
+        n = n < size ? n : size;
+        memcpy(out->buffer + out->used, p, n);
+        out->used += n;
+        p += n;
+        size -= n;
+        if (out->used == out->size) {
+            struct iovec iov = {out->buffer, out->used};
+            out->error = write_all(out->fd, &iov, 1);
+            out->used = 0;
+        }
+    }
+    return out->error;
+}
+
+/*
+ * Write out the buffer.  In direct mode, only whole aligned blocks are
+ * written until the output is closed.
+ */
+int
+output_flush(struct output *out)
+{
+    size_t n = out->used;
+    struct iovec iov;
+
+    if (out->error) {
+        return out->error;
+    }
+    if (out->direct) {
+        n &= ~(size_t)(OUTPUT_ALIGN - 1);
+    }
+    if (n == 0) {
+        return 0;
+    }
+    iov.iov_base = out->buffer;
+    iov.iov_len = n;
+    out->error = write_all(out->fd, &iov, 1);
+    memmove(out->buffer, out->buffer + n, out->used - n);
+    out->used -= n;
+    return out->error;
+}
+
+/*
+ * Write out everything and release the buffer.  Returns 0 on success, or
+ * the errno value of the first failure.
+ */
+int
+output_close(struct output *out)
+{
+    output_flush(out);
+    if (out->direct && out->used && !out->error) {
+        /* Write the unaligned tail without O_DIRECT. */
+        int flags = fcntl(out->fd, F_GETFL);
+        if (flags < 0 || fcntl(out->fd, F_SETFL, flags & ~O_DIRECT) < 0) {
+            out->error = errno;
+        }
+        out->direct = 0;
+        output_flush(out);
+    }
+    if (out->close && close(out->fd) < 0 && !out->error) {
+        out->error = errno;
+    }
+    free(out->buffer);
+    out->buffer = NULL;
+    return out->error;
+}
+
+/* libyaml write handler; data is a struct output. */
+int
+output_handler(void *data, unsigned char *buffer, size_t size)
+{
+    return output_write(data, buffer, size) == 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Buffered output to a file descriptor.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+#define OUTPUT_ALIGN 4096
+
+struct output {
+    int fd;
+    char *buffer;           /* Aligned for direct i/o. */
+    size_t size;            /* Buffer size, a multiple of OUTPUT_ALIGN. */
+    size_t used;            /* Bytes in the buffer. */
+    int direct;             /* The file was opened with O_DIRECT. */
+    int close;              /* Close fd when done. */
+    int error;              /* First errno value, or 0. */
+};
+
+int output_open_fd(struct output *out, int fd, size_t buffer_size);
+int output_open(struct output *out, const char *path, size_t buffer_size, off_t expected_size, int direct);
+int output_write(struct output *out, const void *data, size_t size);
+int output_flush(struct output *out);
+int output_close(struct output *out);
+int output_handler(void *data, unsigned char *buffer, size_t size);
+
+/* Append to the output buffer, writing it out when it is full. */
+static inline int
+output_put(struct output *out, const void *data, size_t size)
+{
+    if (out->used + size <= out->size) {
+        memcpy(out->buffer + out->used, data, size);
+        out->used += size;
+        return 0;
+    }
+    return output_write(out, data, size);
+}
+
+#endif
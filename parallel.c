@@ -0,0 +1,395 @@
+/*
+ * Parallel loading of yaml streams.
+ *
+ * The stream is split at its document boundaries, and each document is
+ * parsed as a stream of its own, with its own libyaml parser and parser
+ * state, by a pool of worker threads.  The workers take the next job from a
+ * shared counter, so a few large jobs do not hold up the rest.
+ *
+ * In chunked mode, the fruit sequence of each document is also split into
+ * chunks at the items of the sequence, the lines starting with "- " at the
+ * indentation of the sequence.  Each chunk after the first is parsed with
+ * the "fruit:" line of its document in front of it, so it is a document of
+ * the fruit grammar on its own.  This is speculative: a split may be wrong,
+ * for example within a multi-line quoted scalar.  Each chunk is checked
+ * afterwards to have produced exactly the fruits it was expected to hold,
+ * and to contain no block scalars, flow collections, anchors or aliases,
+ * which could hide a wrong split.  If any check fails, the whole stream is
+ * parsed again sequentially.
+ *
+ * The catalogs of the jobs are then appended in their original order.
+ * Each worker writes its errors to a memory buffer, and the buffers are
+ * printed in order, up to the first job which failed, so the output does not
+ * depend on the scheduling of the threads.
+ */
+
+#include <yaml.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parallel.h"
+#include "load.h"
+#include "split.h"
+#include "trace.h"
+
+/* Chunks per thread, so the threads finish at about the same time. */
+#define CHUNKS_PER_THREAD 4
+
+struct job {
+    const unsigned char *prefix;  /* Line to parse before the data. */
+    size_t prefix_size;
+    const unsigned char *data;    /* The document or chunk. */
+    size_t size;
+    size_t offset;                /* Bytes of prefix and data read. */
+    size_t document;              /* Number of the document, from 1. */
+    long items;                   /* Fruits expected, or -1 if not a chunk. */
+    int speculative;              /* Check the chunk after parsing. */
+    int valid;                    /* The chunk passed the checks. */
+    struct parser_state state;
+    enum status status;
+    char *log;                    /* Errors and warnings. */
+    size_t loglen;
+};
+
+struct pool {
+    struct job *jobs;
+    size_t njobs;
+    size_t size;                  /* Allocated jobs. */
+    atomic_size_t next;           /* Next job to run. */
+};
+
+static struct job *
+add_job(struct pool *pool, size_t document, const unsigned char *data, size_t size)
+{
+    struct job *job;
+
+    if (pool->njobs == pool->size) {
+        pool->size = pool->size ? pool->size * 2 : 16;
+        pool->jobs = bail_realloc(pool->jobs, pool->size * sizeof(*pool->jobs));
+    }
+    job = &pool->jobs[pool->njobs++];
+    memset(job, 0, sizeof(*job));
+    job->document = document;
+    job->data = data;
+    job->size = size;
+    job->items = -1;
+    return job;
+}
+
+/* libyaml read handler which reads the prefix of a job, then its data. */
+static int
+read_job(void *data, unsigned char *buffer, size_t size, size_t *size_read)
+{
+    struct job *job = data;
+    size_t n = 0;
+
+    if (job->offset < job->prefix_size) {
+        n = job->prefix_size - job->offset;
+        n = n < size ? n : size;
+        memcpy(buffer, job->prefix + job->offset, n);
+    } else if (job->offset < job->prefix_size + job->size) {
+        n = job->prefix_size + job->size - job->offset;
+        n = n < size ? n : size;
+        memcpy(buffer, job->data + (job->offset - job->prefix_size), n);
+    }
+    job->offset += n;
+    *size_read = n;
+    return 1;
+}
+
+/* Check for yaml which could hide a wrong split of a chunk. */
+static int
+is_unsafe(yaml_event_t *event)
+{
+    switch (event->type) {
+    case YAML_ALIAS_EVENT:
+        return 1;
+    case YAML_SCALAR_EVENT:
+        return event->data.scalar.anchor ||
+               event->data.scalar.style == YAML_LITERAL_SCALAR_STYLE ||
+               event->data.scalar.style == YAML_FOLDED_SCALAR_STYLE;
+    case YAML_SEQUENCE_START_EVENT:
+        return event->data.sequence_start.anchor ||
+               event->data.sequence_start.style == YAML_FLOW_SEQUENCE_STYLE;
+    case YAML_MAPPING_START_EVENT:
+        return event->data.mapping_start.anchor ||
+               event->data.mapping_start.style == YAML_FLOW_MAPPING_STYLE;
+    default:
+        return 0;
+    }
+}
+
+/* Parse one job. */
+static void
+run_job(struct job *job)
+{
+    yaml_parser_t parser;
+
+    parser_state_init(&job->state, NULL, NULL);
+    job->state.log = open_memstream(&job->log, &job->loglen);
+    if (!job->state.log) {
+        bail("out of memory");
+    }
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input(&parser, read_job, job);
+    if (!job->speculative) {
+        job->status = load_events(&job->state, &parser);
+    } else {
+        /* Check each event, and do not report errors; the fallback will. */
+        job->status = SUCCESS;
+        job->valid = 1;
+        while (job->state.state != STATE_STOP) {
+            yaml_event_t event;
+
+            if (!yaml_parser_parse(&parser, &event)) {
+                job->valid = 0;
+                break;
+            }
+            TRACE_PARSED(&job->state);
+            if (is_unsafe(&event) || consume_event(&job->state, &event) == FAILURE) {
+                job->valid = 0;
+            }
+            yaml_event_delete(&event);
+            if (!job->valid) {
+                break;
+            }
+        }
+        if (job->state.catalog.nfruits != (size_t)job->items) {
+            job->valid = 0;
+        }
+    }
+    yaml_parser_delete(&parser);
+    fclose(job->state.log);
+    job->state.log = NULL;
+}
+
+static void *
+worker(void *arg)
+{
+    struct pool *pool = arg;
+    size_t i;
+
+    while ((i = atomic_fetch_add(&pool->next, 1)) < pool->njobs) {
+        run_job(&pool->jobs[i]);
+    }
+    return NULL;
+}
+
+/* Get the number of spaces at the start of a line. */
+static size_t
+indentation(const unsigned char *line, const unsigned char *end)
+{
+    const unsigned char *p = line;
+
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    return p - line;
+}
+
+/* Check for a line with only spaces and perhaps a comment. */
+static int
+is_blank(const unsigned char *line, const unsigned char *end)
+{
+    const unsigned char *p = line + indentation(line, end);
+
+    return p == end || *p == '\n' || *p == '\r' || *p == '#';
+}
+
+/* Check for a sequence item at the start of a line, after indent spaces. */
+static int
+is_item(const unsigned char *line, const unsigned char *end, size_t indent)
+{
+    const unsigned char *p = line + indent;
+
+    return end - p >= 2 && p[0] == '-' && (p[1] == ' ' || p[1] == '\n' || p[1] == '\r');
+}
+
+/*
+ * Split a document into chunks at the items of its fruit sequence, and add
+ * a job for each chunk.  If the fruit sequence is not in block style, the
+ * document is added as one job.
+ */
+static void
+add_chunks(struct pool *pool, size_t document, const unsigned char *data, size_t size, size_t nchunks)
+{
+    const unsigned char *end = data + size;
+    const unsigned char *line;
+    const unsigned char *next;
+    const unsigned char *key = NULL;   /* The "fruit:" line. */
+    const unsigned char *start = data; /* Start of the current chunk. */
+    size_t key_size = 0;
+    size_t indent = 0;
+    size_t target;
+    long items = 0;
+    struct job *job;
+
+    /* Find the fruit key, and the indentation of the sequence items. */
+    for (line = data; line < end; line = next) {
+        next = memchr(line, '\n', end - line);
+        next = next ? next + 1 : end;
+        if (is_blank(line, next)) {
+            continue;
+        }
+        if (!key) {
+            size_t n = indentation(line, next);
+            if (next - line - n >= 6 && memcmp(line + n, "fruit:", 6) == 0 &&
+                is_blank(line + n + 6, next)) {
+                key = line;
+                key_size = next - line;
+            }
+            continue;
+        }
+        indent = indentation(line, next);
+        if (!is_item(line, next, indent) || indent < indentation(key, key + key_size)) {
+            key = NULL;
+        }
+        break;
+    }
+    if (!key || line >= end) {
+        add_job(pool, document, data, size);
+        return;
+    }
+
+    /* Split at the first item after each target offset. */
+    target = size / nchunks;
+    for (; line < end; line = next) {
+        next = memchr(line, '\n', end - line);
+        next = next ? next + 1 : end;
+        if (is_blank(line, next)) {
+            continue;
+        }
+        if (indentation(line, next) < indent ||
+            (indentation(line, next) == indent && !is_item(line, next, indent))) {
+            /* The end of the sequence. */
+            break;
+        }
+        if (indentation(line, next) != indent) {
+            continue;
+        }
+        if ((size_t)(line - data) >= target && items > 0) {
+            job = add_job(pool, document, start, line - start);
+            job->items = items;
+            job->speculative = 1;
+            if (start != data) {
+                job->prefix = key;
+                job->prefix_size = key_size;
+            }
+            start = line;
+            items = 0;
+            target = (line - data) + size / nchunks;
+        }
+        items++;
+    }
+    job = add_job(pool, document, start, end - start);
+    job->items = items;
+    job->speculative = 1;
+    if (start != data) {
+        job->prefix = key;
+        job->prefix_size = key_size;
+    }
+}
+
+/* Load a whole stream in this thread. */
+static int
+load_sequential(struct catalog *c, const unsigned char *data, size_t size)
+{
+    struct parser_state state;
+    yaml_parser_t parser;
+    int status;
+
+    parser_state_init(&state, NULL, NULL);
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, data, size);
+    status = load_events(&state, &parser);
+    if (status == SUCCESS) {
+        catalog_append(c, &state.catalog);
+    }
+    yaml_parser_delete(&parser);
+    parser_state_destroy(&state);
+    return status;
+}
+
+/*
+ * Load the documents of a stream into a catalog using up to nthreads
+ * threads, splitting each document into chunks if chunked is set.  Returns
+ * SUCCESS, or FAILURE if any document failed to load, in which case the
+ * documents before it are loaded.
+ */
+int
+load_parallel(struct catalog *c, const unsigned char *data, size_t size, int nthreads, int chunked)
+{
+    struct pool pool;
+    struct span *spans;
+    size_t nspans;
+    pthread_t *threads;
+    int status = SUCCESS;
+    int fallback = 0;
+    int n;
+
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    memset(&pool, 0, sizeof(pool));
+    atomic_init(&pool.next, 0);
+    nspans = split_documents(data, size, &spans);
+    for (size_t i = 0; i < nspans; i++) {
+        const unsigned char *document = data + spans[i].offset;
+        size_t nchunks = (nthreads * CHUNKS_PER_THREAD * spans[i].length) / size;
+
+        if (chunked && nchunks > 1) {
+            add_chunks(&pool, i + 1, document, spans[i].length, nchunks);
+        } else {
+            add_job(&pool, i + 1, document, spans[i].length);
+        }
+    }
+    bail_free(ALLOC_OTHER, spans);
+
+    if ((size_t)nthreads > pool.njobs) {
+        nthreads = pool.njobs;
+    }
+    threads = bail_alloc(nthreads * sizeof(*threads));
+    for (n = 0; n < nthreads; n++) {
+        if (pthread_create(&threads[n], NULL, worker, &pool)) {
+            break;
+        }
+    }
+    if (n == 0) {
+        /* No threads could be started, so do the work here. */
+        worker(&pool);
+    }
+    for (int i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    bail_free(ALLOC_OTHER, threads);
+
+    for (size_t i = 0; i < pool.njobs; i++) {
+        if (pool.jobs[i].speculative && !pool.jobs[i].valid) {
+            fallback = 1;
+        }
+    }
+    for (size_t i = 0; i < pool.njobs; i++) {
+        struct job *job = &pool.jobs[i];
+
+        if (status == SUCCESS && !fallback) {
+            fwrite(job->log, 1, job->loglen, stderr);
+            if (job->status == SUCCESS) {
+                catalog_append(c, &job->state.catalog);
+            } else {
+                fprintf(stderr, "Failed to load document %zu.\n", job->document);
+                status = FAILURE;
+            }
+        }
+        free(job->log);
+        parser_state_destroy(&job->state);
+    }
+    bail_free(ALLOC_OTHER, pool.jobs);
+
+    if (fallback) {
+        status = load_sequential(c, data, size);
+    }
+    return status;
+}
@@ -0,0 +1,14 @@
+/*
+ * Parallel loading of yaml streams.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+#include "fruit.h"
+
+int load_parallel(struct catalog *c, const unsigned char *data, size_t size, int nthreads, int chunked);
+
+#endif
@@ -88,410 +88,557 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
 #include <errno.h>
+#include <sys/mman.h>
 
 #include "fruit.h"
+#include "input.h"
+#include "load.h"
+#include "parallel.h"
+#include "tape.h"
+#include "cache.h"
+#include "index.h"
+#include "names.h"
+#include "snapshot.h"
+#include "trace.h"
+
+/* Set with --stats to print string and allocation statistics to stderr. */
+int stats = 0;
+
+/* Cleared with --no-varieties to print only the fields of fruits. */
+int print_varieties = 1;
 
-/* Set environment variable DEBUG=1 to enable debug output. */
-int debug = 0;
-
-/* yaml_* functions return 1 on success and 0 on failure. */
-enum status {
-    SUCCESS = 1,
-    FAILURE = 0
-};
+/*
+ * Print the string interning statistics.
+ */
+void
+print_intern_stats(struct intern *t)
+{
+    fprintf(stderr, "intern: lookups=%lu, hits=%lu (%.1f%%), unique=%zu, bytes=%lu, saved=%lu\n",
+            t->lookups, t->hits,
+            t->lookups ? 100.0 * t->hits / t->lookups : 0.0,
+            t->count, t->bytes, t->saved);
+}
 
-/* Our example parser states. */
-enum state {
-    STATE_START,    /* start state */
-    STATE_STREAM,   /* start/end stream */
-    STATE_DOCUMENT, /* start/end document */
-    STATE_SECTION,  /* top level */
+void
+usage(void)
+{
+    fprintf(stderr, "usage: parse [--stats] [--stream | --jobs N [--chunked]] [--tape]\n"
+                    "             [--where KEY=VALUE] [--limit N] [--lazy] [--no-varieties]\n"
+                    "             [--snapshot] [--duplicates reject|last|merge] [--find NAME[/VARIETY]]\n"
+                    "             [--trace] [--folded FILE] [input.yaml]\n"
+                    "       parse [--stats] --cache input.yaml...\n"
+                    "       parse --index input.yaml\n"
+                    "       parse [--stats] --lookup NAME input.yaml\n");
+    exit(EXIT_FAILURE);
+}
 
-    STATE_FLIST,    /* fruit list */
-    STATE_FVALUES,  /* fruit key-value pairs */
-    STATE_FKEY,     /* fruit key */
-    STATE_FNAME,    /* fruit name value */
-    STATE_FCOLOR,   /* fruit color value */
-    STATE_FCOUNT,   /* fruit count value */
+/*
+ * Print the fields of a fruit.
+ */
+void
+print_fields(const char *name, const char *color, int64_t count)
+{
+    printf("fruit: name=%s, color=%s, count=%" PRId64 "\n", name, color, count);
+}
 
-    STATE_VLIST,    /* varieties list */
-    STATE_VVALUES,  /* variety key-value pairs */
-    STATE_VKEY,     /* variety key */
-    STATE_VNAME,    /* variety name */
-    STATE_VCOLOR,   /* variety color */
-    STATE_VSEEDLESS,/* variety seedless */
+void
+print_variety(const char *name, const char *color, bool seedless)
+{
+    printf("  variety: name=%s, color=%s, seedless=%s\n", name, color, seedless ? "true" : "false");
+}
 
-    STATE_STOP      /* end state */
-};
+/*
+ * Print a fruit and its varieties.  Returns FAILURE if its varieties were
+ * left unparsed and fail to parse now.
+ */
+enum status
+print_fruit(struct catalog *c, struct catalog_fruit *f)
+{
+    struct catalog_variety *v;
 
-/* Our application parser state data. */
-struct parser_state {
-    enum state state;      /* The current parse state */
-    struct fruit f;        /* Fruit data elements. */
-    struct variety v;      /* Variety data elements. */
-    struct variety *vlist; /* List of 'variety' objects. */
-    struct fruit *flist;   /* List of 'fruit' objects. */
-};
+    print_fields(f->name, f->color, f->count);
+    if (!print_varieties) {
+        return SUCCESS;
+    }
+    if (!(v = catalog_load_varieties(c, f))) {
+        return FAILURE;
+    }
+    for (size_t j = 0; j < f->nvarieties; j++, v++) {
+        print_variety(v->name, v->color, v->seedless);
+    }
+    return SUCCESS;
+}
 
 /*
- * Convert a yaml boolean string to a boolean value (true|false).
+ * Print the fruits of a catalog, stopping at the first whose varieties fail
+ * to parse.  Returns EXIT_SUCCESS or EXIT_FAILURE.
  */
 int
-get_boolean(const char *string, bool *value)
+print_catalog(struct catalog *c)
 {
-    char *t[] = {"y", "Y", "yes", "Yes", "YES", "true", "True", "TRUE", "on", "On", "ON", NULL};
-    char *f[] = {"n", "N", "no", "No", "NO", "false", "False", "FALSE", "off", "Off", "OFF", NULL};
-    char **p;
-
-    for (p = t; *p; p++) {
-        if (strcmp(string, *p) == 0) {
-            *value = true;
-            return 0;
+    for (size_t i = 0; i < c->nfruits; i++) {
+        if (print_fruit(c, &c->fruits[i]) == FAILURE) {
+            return EXIT_FAILURE;
         }
     }
-    for (p = f; *p; p++) {
-        if (strcmp(string, *p) == 0) {
-            *value = false;
-            return 0;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Print the fruits of a snapshot, in place.
+ */
+void
+print_snapshot(const struct snapshot *snap)
+{
+    for (size_t i = 0; i < snap->nfruits; i++) {
+        const struct snapshot_fruit *f = &snap->fruits[i];
+        const struct snapshot_variety *v = &snap->varieties[f->variety];
+
+        print_fields(snapshot_string(snap, f->name), snapshot_string(snap, f->color), f->count);
+        for (size_t j = 0; print_varieties && j < f->nvarieties; j++, v++) {
+            print_variety(snapshot_string(snap, v->name), snapshot_string(snap, v->color), v->seedless);
         }
     }
-    return EINVAL;
 }
 
+/*
+ * Get the path of a file kept next to another, such as its index.
+ */
+char *
+sidecar_path(const char *path, const char *suffix)
+{
+    char *sidecar = bail_alloc(strlen(path) + strlen(suffix) + 1);
+
+    strcpy(sidecar, path);
+    strcat(sidecar, suffix);
+    return sidecar;
+}
+
+/*
+ * Print a fruit found by name through the name index of the catalog, or
+ * only one of its varieties if the name is "fruit/variety".
+ */
+int
+find_fruit(struct catalog *c, const char *find)
+{
+    const char *slash = strchr(find, '/');
+    const char *name = slash ? catalog_strndup(c, find, slash - find) : find;
+    uint64_t start = trace_now();
+    struct catalog_fruit *f = catalog_find_fruit(c, name);
+    struct catalog_variety *v = f && slash ? catalog_find_variety(c, f, slash + 1) : NULL;
+    uint64_t found = trace_now();
+
+    if (stats) {
+        fprintf(stderr, "find: %s in %.3f us\n", find, (found - start) / 1e3);
+    }
+    if (!f || (slash && !v)) {
+        fprintf(stderr, "%s: not found\n", find);
+        return EXIT_FAILURE;
+    }
+    if (slash) {
+        print_fields(f->name, f->color, f->count);
+        print_variety(v->name, v->color, v->seedless);
+    } else if (print_fruit(c, f) == FAILURE) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
 
 /*
- * Consume yaml events generated by the libyaml parser to
- * import our data into raw c data structures. Error processing
- * is keep to a mimimum since this is just an example.
+ * Print each fruit as soon as it is parsed.
  */
-int consume_event(struct parser_state *s, yaml_event_t *event)
+enum status
+stream_fruit(struct catalog *c, struct catalog_fruit *f, void *data)
 {
-    char *value;
+    return print_fruit(c, f);
+}
 
-    if (debug) {
-        printf("state=%d event=%d\n", s->state, event->type);
-    }
-    switch (s->state) {
-    case STATE_START:
-        switch (event->type) {
-        case YAML_STREAM_START_EVENT:
-            s->state = STATE_STREAM;
+/*
+ * Load each file in turn through one document cache, as a long-running
+ * process reloads a file which changes, and print the last catalog.
+ */
+int
+load_cached(char **paths, int npaths)
+{
+    struct cache cache;
+    struct input input;
+    int code = EXIT_SUCCESS;
+
+    cache_init(&cache);
+    for (int i = 0; i < npaths && code == EXIT_SUCCESS; i++) {
+        uint64_t start = trace_now();
+        int error = input_map(&input, paths[i]);
+
+        if (error) {
+            fprintf(stderr, "%s: %s\n", paths[i], strerror(error));
+            code = EXIT_FAILURE;
             break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
         }
-        break;
+        if (cache_load(&cache, input.data, input.size) == FAILURE) {
+            code = EXIT_FAILURE;
+        }
+        input_close(&input);
+        if (stats) {
+            fprintf(stderr, "cache: %s: %zu documents, %zu reused, %zu parsed in %.3f ms\n",
+                    paths[i], cache.nentries, cache.reused, cache.parsed, (trace_now() - start) / 1e6);
+        }
+    }
+    if (code == EXIT_SUCCESS) {
+        code = print_catalog(&cache.catalog);
+        if (stats) {
+            alloc_report(stderr, cache.catalog.nfruits, cache.catalog.nvarieties);
+        }
+    }
+    cache_destroy(&cache);
+    return code;
+}
 
-     case STATE_STREAM:
-        switch (event->type) {
-        case YAML_DOCUMENT_START_EVENT:
-            s->state = STATE_DOCUMENT;
-            break;
-        case YAML_STREAM_END_EVENT:
-            s->state = STATE_STOP;  /* All done. */
-            break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
+/*
+ * Build the index of a file, or look up the fruits with a name in it.
+ */
+int
+use_index(const char *path, const char *lookup)
+{
+    char *index_path = sidecar_path(path, INDEX_SUFFIX);
+    struct fruit_index idx;
+    struct parser_state state;
+    struct input input;
+    const struct index_entry *e;
+    uint64_t start = trace_now();
+    size_t n;
+    int code = EXIT_FAILURE;
+    int error;
+
+    if ((error = input_map(&input, path))) {
+        fprintf(stderr, "%s: %s\n", path, strerror(error));
+        goto done;
+    }
+    if (!lookup) {
+        if ((error = index_build(path, input.data, input.size, index_path)) > 0) {
+            fprintf(stderr, "%s: %s\n", index_path, strerror(error));
+        }
+        code = error ? EXIT_FAILURE : EXIT_SUCCESS;
+        goto unmap;
+    }
+    if ((error = index_open(&idx, index_path, path))) {
+        fprintf(stderr, "%s: %s\n", index_path, error == ESTALE ? "out of date" : strerror(error));
+        goto unmap;
+    }
+    /* Only a few pages of the file will be read. */
+    if (input.map) {
+        madvise(input.map, input.size, MADV_RANDOM);
+    }
+    parser_state_init(&state, NULL, NULL);
+    n = index_find(&idx, lookup, &e);
+    code = n > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    for (size_t i = 0; i < n && code == EXIT_SUCCESS; i++) {
+        if (index_load(&state, &idx, &e[i], input.data, input.size) == FAILURE) {
+            code = EXIT_FAILURE;
         }
-        break;
+    }
+    if (stats) {
+        fprintf(stderr, "lookup: %zu of %zu fruits in %.3f ms\n", n, idx.nentries, (trace_now() - start) / 1e6);
+    }
+    if (n == 0) {
+        fprintf(stderr, "%s: not found\n", lookup);
+    }
+    if (print_catalog(&state.catalog) == EXIT_FAILURE) {
+        code = EXIT_FAILURE;
+    }
+    parser_state_destroy(&state);
+    index_close(&idx);
+unmap:
+    input_close(&input);
+done:
+    bail_free(ALLOC_OTHER, index_path);
+    return code;
+}
 
-     case STATE_DOCUMENT:
-        switch (event->type) {
-        case YAML_MAPPING_START_EVENT:
-            s->state = STATE_SECTION;
+int
+main(int argc, char *argv[])
+{
+    int code;
+    struct parser_state state;
+    yaml_parser_t parser;
+    struct input input;
+    const char *path = NULL;
+    int stream = 0;
+    int jobs = 0;
+    int chunked = 0;
+    int tape = 0;
+    struct tape t;
+    int cached = 0;
+    int build_index = 0;
+    const char *lookup = NULL;
+    const char *where = NULL;
+    long limit = 0;
+    int lazy = 0;
+    int use_snapshot = 0;
+    char *snapshot_path = NULL;
+    struct snapshot snap;
+    int duplicates = -1;
+    const char *find = NULL;
+    int trace = 0;
+    const char *folded = NULL;
+    uint64_t start = 0;
+    struct option options[] = {
+        {"stats", no_argument, NULL, 's'},
+        {"stream", no_argument, NULL, 'S'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"chunked", no_argument, NULL, 'c'},
+        {"tape", no_argument, NULL, 't'},
+        {"trace", no_argument, NULL, 'T'},
+        {"folded", required_argument, NULL, 'F'},
+        {"cache", no_argument, NULL, 'C'},
+        {"index", no_argument, NULL, 'i'},
+        {"lookup", required_argument, NULL, 'l'},
+        {"where", required_argument, NULL, 'w'},
+        {"limit", required_argument, NULL, 'n'},
+        {"lazy", no_argument, NULL, 'z'},
+        {"no-varieties", no_argument, NULL, 'V'},
+        {"snapshot", no_argument, NULL, 'P'},
+        {"duplicates", required_argument, NULL, 'd'},
+        {"find", required_argument, NULL, 'f'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "sSj:ctTF:Cil:w:n:zVPd:f:", options, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            stats = 1;
+            alloc_accounting = 1;
             break;
-        case YAML_DOCUMENT_END_EVENT:
-            s->state = STATE_STREAM;
+        case 'S':
+            stream = 1;
             break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
-        }
-        break;
-
-    case STATE_SECTION:
-        switch (event->type) {
-        case YAML_SCALAR_EVENT:
-            value = (char *)event->data.scalar.value;
-            if (strcmp(value, "fruit") == 0) {
-               s->state = STATE_FLIST;
-            } else {
-               fprintf(stderr, "Unexpected scalar: %s\n", value);
-               return FAILURE;
+        case 'j':
+            jobs = atoi(optarg);
+            if (jobs < 1) {
+                usage();
             }
             break;
-        case YAML_DOCUMENT_END_EVENT:
-            s->state = STATE_STREAM;
+        case 'c':
+            chunked = 1;
             break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
-        }
-        break;
-
-    case STATE_FLIST:
-        switch (event->type) {
-        case YAML_SEQUENCE_START_EVENT:
-            s->state = STATE_FVALUES;
+        case 't':
+            tape = 1;
             break;
-        case YAML_MAPPING_END_EVENT:
-            s->state = STATE_SECTION;
+        case 'T':
+            trace = 1;
             break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
-        }
-        break;
-
-    case STATE_FVALUES:
-        switch (event->type) {
-        case YAML_MAPPING_START_EVENT:
-            s->state = STATE_FKEY;
+        case 'F':
+            folded = optarg;
             break;
-        case YAML_SEQUENCE_END_EVENT:
-            s->state = STATE_FLIST;
+        case 'C':
+            cached = 1;
             break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
-        }
-        break;
-
-    case STATE_FKEY:
-        switch (event->type) {
-        case YAML_SCALAR_EVENT:
-            value = (char *)event->data.scalar.value;
-            if (strcmp(value, "name") == 0) {
-                s->state = STATE_FNAME;
-            } else if (strcmp(value, "color") == 0) {
-                s->state = STATE_FCOLOR;
-            } else if (strcmp(value, "count") == 0) {
-                s->state = STATE_FCOUNT;
-            } else if (strcmp(value, "varieties") == 0) {
-                s->state = STATE_VLIST;
-            } else {
-                fprintf(stderr, "Unexpected key: %s\n", value);
-                return FAILURE;
-            }
+        case 'i':
+            build_index = 1;
             break;
-        case YAML_MAPPING_END_EVENT:
-            add_fruit(&s->flist, s->f.name, s->f.color, s->f.count, s->vlist);
-            free(s->f.name);
-            free(s->f.color);
-            memset(&s->f, 0, sizeof(s->f));
-            s->vlist = NULL;
-            s->state = STATE_FVALUES;
+        case 'l':
+            lookup = optarg;
             break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
-        }
-        break;
-
-    case STATE_FNAME:
-        switch (event->type) {
-        case YAML_SCALAR_EVENT:
-            if (s->f.name) {
-                fprintf(stderr, "Warning: duplicate 'name' key.\n");
-                free(s->f.name);
-            }
-            s->f.name = bail_strdup((char *)event->data.scalar.value);
-            s->state = STATE_FKEY;
+        case 'w':
+            where = optarg;
             break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
-        }
-        break;
-
-    case STATE_FCOLOR:
-        switch (event->type) {
-        case YAML_SCALAR_EVENT:
-            if (s->f.color) {
-                fprintf(stderr, "Warning: duplicate 'color' key.\n");
-                free(s->f.color);
+        case 'n':
+            limit = atol(optarg);
+            if (limit < 1) {
+                usage();
             }
-            s->f.color = bail_strdup((char *)event->data.scalar.value);
-            s->state = STATE_FKEY;
             break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
-        }
-        break;
-
-    case STATE_FCOUNT:
-        switch (event->type) {
-        case YAML_SCALAR_EVENT:
-            s->f.count = atoi((char *)event->data.scalar.value);
-            s->state = STATE_FKEY;
+        case 'z':
+            lazy = 1;
             break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
-        }
-        break;
-
-    case STATE_VLIST:
-        switch (event->type) {
-        case YAML_SEQUENCE_START_EVENT:
-            s->state = STATE_VVALUES;
-            break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
-        }
-        break;
-
-    case STATE_VVALUES:
-        switch (event->type) {
-        case YAML_MAPPING_START_EVENT:
-            s->state = STATE_VKEY;
+        case 'V':
+            print_varieties = 0;
             break;
-        case YAML_SEQUENCE_END_EVENT:
-            s->state = STATE_FKEY;
+        case 'P':
+            use_snapshot = 1;
             break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
-        }
-        break;
-
-    case STATE_VKEY:
-        switch (event->type) {
-        case YAML_SCALAR_EVENT:
-            value = (char *)event->data.scalar.value;
-            if (strcmp(value, "name") == 0) {
-                s->state = STATE_VNAME;
-            } else if (strcmp(value, "color") == 0) {
-                s->state = STATE_VCOLOR;
-            } else if (strcmp(value, "seedless") == 0) {
-                s->state = STATE_VSEEDLESS;
+        case 'd':
+            if (strcmp(optarg, "reject") == 0) {
+                duplicates = DUPLICATES_REJECT;
+            } else if (strcmp(optarg, "last") == 0) {
+                duplicates = DUPLICATES_LAST;
+            } else if (strcmp(optarg, "merge") == 0) {
+                duplicates = DUPLICATES_MERGE;
             } else {
-                fprintf(stderr, "Unexpected key: %s\n", value);
-                return FAILURE;
+                usage();
             }
             break;
-        case YAML_MAPPING_END_EVENT:
-            add_variety(&s->vlist, s->v.name, s->v.color, s->v.seedless);
-            free(s->v.name);
-            free(s->v.color);
-            memset(&s->v, 0, sizeof(s->v));
-            s->state = STATE_VVALUES;
+        case 'f':
+            find = optarg;
             break;
         default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
+            usage();
         }
-        break;
-
-    case STATE_VNAME:
-        switch (event->type) {
-        case YAML_SCALAR_EVENT:
-            if (s->v.name) {
-                fprintf(stderr, "Warning: duplicate 'name' key.\n");
-                free(s->v.name);
-            }
-            s->v.name = bail_strdup((char *)event->data.scalar.value);
-            s->state = STATE_VKEY;
-            break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
+    }
+    if (cached || build_index || lookup) {
+        if ((cached ? optind == argc : optind != argc - 1) || cached + build_index + !!lookup > 1 ||
+            stream || jobs || tape || where || limit || lazy || use_snapshot || duplicates >= 0 || find) {
+            usage();
         }
-        break;
+    } else if (optind < argc - 1 || (stream && jobs) || (chunked && !jobs) || (tape && jobs) ||
+               (jobs && (where || limit)) || (lazy && (jobs || tape || optind == argc)) ||
+               (use_snapshot && (stream || tape || where || limit || lazy || optind == argc)) ||
+               ((duplicates >= 0 || find) && (stream || jobs || lazy)) || (find && use_snapshot)) {
+        usage();
+    }
+#ifdef NO_TRACE
+    if (trace || folded) {
+        fprintf(stderr, "parse: built without tracing\n");
+        return EXIT_FAILURE;
+    }
+#endif
+    if (trace || folded) {
+        tracing = 1;
+        start = trace_now();
+    }
+    if (cached) {
+        code = load_cached(argv + optind, argc - optind);
+        goto report;
+    }
+    if (build_index || lookup) {
+        code = use_index(argv[optind], lookup);
+        goto report;
+    }
 
-    case STATE_VCOLOR:
-        switch (event->type) {
-        case YAML_SCALAR_EVENT:
-            if (s->v.color) {
-                fprintf(stderr, "Warning: duplicate 'color' key.\n");
-                free(s->v.color);
+    parser_state_init(&state, stream ? stream_fruit : NULL, NULL);
+    yaml_parser_initialize(&parser);
+    memset(&input, 0, sizeof(input));
+    if (duplicates >= 0) {
+        /* Check each fruit against the names of those before it. */
+        catalog_set_names(&state.catalog, duplicates);
+    }
+    if ((where || limit) && parser_state_set_filter(&state, where, limit) == FAILURE) {
+        code = EXIT_FAILURE;
+        goto done;
+    }
+    if (optind < argc) {
+        /* Read the file in place, instead of through stdio. */
+        path = argv[optind];
+        code = input_map(&input, path);
+    } else if (jobs || tape) {
+        /* The whole stream is needed to split it into documents. */
+        path = "stdin";
+        code = input_read(&input, stdin);
+    } else {
+        code = 0;
+    }
+    if (code) {
+        fprintf(stderr, "%s: %s\n", path, strerror(code));
+        code = EXIT_FAILURE;
+        goto done;
+    }
+    if (use_snapshot) {
+        /* Use the snapshot of the last load, if the file has not changed. */
+        uint64_t opened = trace_now();
+        int error;
+
+        snapshot_path = sidecar_path(path, SNAPSHOT_SUFFIX);
+        if (!(error = snapshot_open(&snap, snapshot_path, path, input.data, input.size, duplicates))) {
+            if (stats) {
+                fprintf(stderr, "snapshot: %s: %zu fruits in %.3f ms\n", snapshot_path, snap.nfruits,
+                        (trace_now() - opened) / 1e6);
             }
-            s->v.color = bail_strdup((char *)event->data.scalar.value);
-            s->state = STATE_VKEY;
-            break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
+            print_snapshot(&snap);
+            snapshot_close(&snap);
+            code = EXIT_SUCCESS;
+            goto done;
         }
-        break;
-
-    case STATE_VSEEDLESS:
-        switch (event->type) {
-        case YAML_SCALAR_EVENT:
-            if (get_boolean((char *)event->data.scalar.value, &s->v.seedless)) {
-                fprintf(stderr, "Invalid boolean string value: %s\n",
-                       (char *)event->data.scalar.value);
-                return FAILURE;
-            }
-            s->state = STATE_VKEY;
-            break;
-        default:
-            fprintf(stderr, "Unexpected event %d in state %d.\n", event->type, s->state);
-            return FAILURE;
+        if (stats) {
+            fprintf(stderr, "snapshot: %s: %s, loading the yaml\n", snapshot_path,
+                    error == ESTALE ? "out of date" : strerror(error));
         }
-        break;
-
-    case STATE_STOP:
-        break;
-    }
-    return SUCCESS;
-}
-
-int
-main(int argc, char *argv[])
-{
-    int code;
-    enum status status;
-    struct parser_state state;
-    yaml_parser_t parser;
-
-    if (getenv("DEBUG")) {
-        debug = 1;
     }
-
-    memset(&state, 0, sizeof(state));
-    state.state = STATE_START;
-    yaml_parser_initialize(&parser);
-    yaml_parser_set_input_file(&parser, stdin);
-    do {
-        yaml_event_t event;
-
-        status = yaml_parser_parse(&parser, &event);
-        if (status == FAILURE) {
-            fprintf(stderr, "yaml_parser_parse error\n");
+    if (tape) {
+        /* Replay the recorded events, without parsing any yaml. */
+        if (tape_open(&t, input.data, input.size)) {
+            fprintf(stderr, "%s: not an event tape\n", path);
+            code = EXIT_FAILURE;
+            goto done;
+        }
+        if (load_tape(&state, &t) == FAILURE) {
             code = EXIT_FAILURE;
             goto done;
         }
-        status = consume_event(&state, &event);
-        yaml_event_delete(&event);
-        if (status == FAILURE) {
-            fprintf(stderr, "consume_event error\n");
+    } else if (jobs) {
+        if (load_parallel(&state.catalog, input.data, input.size, jobs, chunked) == FAILURE) {
             code = EXIT_FAILURE;
             goto done;
         }
-    } while (state.state != STATE_STOP);
+    } else {
+        if (path) {
+            yaml_parser_set_input_string(&parser, input.data, input.size);
+            if (lazy) {
+                /*
+                 * The file stays mapped until the fruits are printed.  A
+                 * file which is not UTF-8 is loaded eagerly.
+                 */
+                parser_state_set_lazy(&state, input.data, input.size);
+            }
+        } else {
+            yaml_parser_set_input_file(&parser, stdin);
+        }
+        if (load_events(&state, &parser) == FAILURE) {
+            code = EXIT_FAILURE;
+            goto done;
+        }
+    }
+
+    if (snapshot_path) {
+        int error = snapshot_write(&state.catalog, path, input.data, input.size, snapshot_path);
+
+        if (error) {
+            fprintf(stderr, "%s: %s\n", snapshot_path, strerror(error));
+        }
+    }
 
-    /* Output the parsed data. */
-    for (struct fruit *f = state.flist; f; f = f->next) {
-        printf("fruit: name=%s, color=%s, count=%d\n", f->name, f->color, f->count);
-        for (struct variety *v = f->varieties; v; v = v->next) {
-            printf("  variety: name=%s, color=%s, seedless=%s\n", v->name, v->color, v->seedless ? "true" : "false");
+    if (find) {
+        if (!state.catalog.names) {
+            /* Index the fruits as loaded; the last of the same name is found. */
+            catalog_set_names(&state.catalog, DUPLICATES_LAST);
         }
+        code = find_fruit(&state.catalog, find);
+    } else {
+        /* Output the parsed data, unless it was output as it was parsed. */
+        code = print_catalog(&state.catalog);
+    }
+    if (stats) {
+        if (state.catalog.names) {
+            fprintf(stderr, "names: %zu fruits, %zu varieties, %lu duplicates\n", state.catalog.names->fruits_count,
+                    state.catalog.names->varieties_count, state.catalog.names->duplicates);
+        }
+        if (where || limit) {
+            fprintf(stderr, "filter: %zu fruits kept, %zu dropped\n", state.filter.kept, state.filter.dropped);
+        }
+        print_intern_stats(&state.catalog.strings);
+        alloc_report(stderr, state.catalog.nfruits, state.catalog.nvarieties);
     }
-    code = EXIT_SUCCESS;
 
 done:
-    free(state.f.name);
-    free(state.f.color);
-    free(state.v.name);
-    free(state.v.color);
-    destroy_fruits(&state.flist);
-    destroy_varieties(&state.vlist);
+    parser_state_destroy(&state);
     yaml_parser_delete(&parser);
+    input_close(&input);
+    bail_free(ALLOC_OTHER, snapshot_path);
+report:
+    if (trace) {
+        trace_report(stderr, (trace_now() - start) / 1e9);
+    }
+    if (folded) {
+        FILE *fp = fopen(folded, "w");
+
+        if (!fp) {
+            perror(folded);
+            return EXIT_FAILURE;
+        }
+        trace_folded(fp);
+        fclose(fp);
+    }
     return code;
 }
@@ -0,0 +1,161 @@
+/*
+ * Reloading a catalog while other threads read it.
+ *
+ * The versions are reclaimed with epochs.  A reload publishes the new
+ * version, then advances the global epoch and tags the old version with the
+ * new epoch.  A reader announces the epoch it enters in before it reads the
+ * current version, so a reader which entered in the tag epoch or later
+ * cannot have the old version.  The old version is freed once no reader is
+ * in a section entered in an earlier epoch.  A reader which stays in a
+ * section delays the freeing of the versions retired meanwhile, but never
+ * blocks the reloads.
+ */
+
+#include <yaml.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reload.h"
+#include "input.h"
+#include "load.h"
+
+/* Load the file into a new version, or return NULL after reporting the errors. */
+static struct reload_version *
+load_version(struct reload *r)
+{
+    struct reload_version *v;
+    struct parser_state state;
+    yaml_parser_t parser;
+    struct input input;
+    enum status status;
+    int error;
+
+    if ((error = input_map(&input, r->path))) {
+        fprintf(stderr, "%s: %s\n", r->path, strerror(error));
+        return NULL;
+    }
+    parser_state_init(&state, NULL, NULL);
+    catalog_set_names(&state.catalog, r->policy);
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, input.data, input.size);
+    status = load_events(&state, &parser);
+    yaml_parser_delete(&parser);
+    input_close(&input);
+    if (status == FAILURE) {
+        parser_state_destroy(&state);
+        return NULL;
+    }
+    v = bail_alloc(sizeof(*v));
+    catalog_move(&v->catalog, &state.catalog);
+    parser_state_destroy(&state);
+    v->generation = ++r->generation;
+    return v;
+}
+
+static void
+free_version(struct reload_version *v)
+{
+    catalog_destroy(&v->catalog);
+    bail_free(ALLOC_OTHER, v);
+}
+
+/*
+ * Load the file at path as the first version, for up to nreaders reader
+ * threads.  Returns SUCCESS, or FAILURE after reporting the errors.
+ */
+int
+reload_init(struct reload *r, const char *path, size_t nreaders, enum duplicates policy)
+{
+    struct reload_version *v;
+
+    memset(r, 0, sizeof(*r));
+    r->path = path;
+    r->policy = policy;
+    r->nreaders = nreaders;
+    r->readers = aligned_alloc(_Alignof(struct reload_reader), (nreaders + 1) * sizeof(*r->readers));
+    if (!r->readers) {
+        bail("out of memory");
+    }
+    for (size_t i = 0; i < nreaders; i++) {
+        atomic_init(&r->readers[i].epoch, 0);
+    }
+    atomic_init(&r->epoch, 1);
+    if (!(v = load_version(r))) {
+        free(r->readers);
+        return FAILURE;
+    }
+    atomic_init(&r->current, v);
+    return SUCCESS;
+}
+
+/*
+ * Load the file again and publish it as the current version, then free the
+ * retired versions no reader can still have.  Readers are not held up.  If
+ * the file fails to load, the current version stays.  Returns SUCCESS, or
+ * FAILURE after reporting the errors.
+ */
+int
+reload_update(struct reload *r)
+{
+    struct reload_version *v = load_version(r);
+    struct reload_version *old;
+
+    if (!v) {
+        return FAILURE;
+    }
+    old = atomic_exchange(&r->current, v);
+    old->retired = atomic_fetch_add(&r->epoch, 1) + 1;
+    old->next = r->retired;
+    r->retired = old;
+    r->nretired++;
+    reload_collect(r);
+    return SUCCESS;
+}
+
+/*
+ * Free the retired versions which no reader can still have.  Returns the
+ * number of versions left to free later.
+ */
+size_t
+reload_collect(struct reload *r)
+{
+    uint_fast64_t oldest = UINT64_MAX;
+    struct reload_version **link;
+
+    for (size_t i = 0; i < r->nreaders; i++) {
+        uint_fast64_t epoch = atomic_load(&r->readers[i].epoch);
+
+        if (epoch && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    /* The list is newest first, so the versions to free are at its end. */
+    for (link = &r->retired; *link && (*link)->retired > oldest; link = &(*link)->next) {
+    }
+    while (*link) {
+        struct reload_version *v = *link;
+
+        *link = v->next;
+        free_version(v);
+        r->nretired--;
+        r->reclaimed++;
+    }
+    return r->nretired;
+}
+
+/* Free every version.  No reader may be in a section. */
+void
+reload_destroy(struct reload *r)
+{
+    while (r->retired) {
+        struct reload_version *v = r->retired;
+
+        r->retired = v->next;
+        free_version(v);
+    }
+    free_version(atomic_load(&r->current));
+    free(r->readers);
+    memset(r, 0, sizeof(*r));
+}
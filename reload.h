@@ -0,0 +1,80 @@
+/*
+ * Reloading a catalog while other threads read it.
+ *
+ * Each load of the yaml file is a version of the catalog.  A reload parses
+ * the file into a new version, and publishes it by swapping one atomic
+ * pointer, so readers see either the whole old version or the whole new
+ * one.  Readers take no lock and never wait: a reader enters a read-side
+ * section with reload_enter(), which returns the current version, and
+ * leaves it with reload_leave().  A version which has been replaced is
+ * retired, and freed by the reloading thread once every reader has left
+ * the sections it may have been read in.
+ *
+ * Each reader thread has its own slot, numbered from 0, out of the number
+ * given to reload_init().  Only one thread at a time may call
+ * reload_update(), reload_collect() or reload_destroy().
+ */
+
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fruit.h"
+#include "names.h"
+
+struct reload_version {
+    struct catalog catalog;         /* With a name index, for lookups. */
+    uint64_t generation;            /* Number of the load, from 1. */
+    uint64_t retired;               /* Epoch in which it was replaced. */
+    struct reload_version *next;    /* Next retired version. */
+};
+
+/* The state of a reader, alone in its cache line. */
+struct reload_reader {
+    _Alignas(64) atomic_uint_fast64_t epoch;    /* Epoch entered in, 0 outside sections. */
+};
+
+struct reload {
+    _Atomic(struct reload_version *) current;
+    atomic_uint_fast64_t epoch;     /* Global epoch, from 1. */
+    struct reload_reader *readers;
+    size_t nreaders;
+    const char *path;
+    enum duplicates policy;
+    uint64_t generation;            /* Versions loaded. */
+    struct reload_version *retired; /* Replaced versions, newest first. */
+    size_t nretired;
+    size_t reclaimed;               /* Retired versions freed. */
+};
+
+int reload_init(struct reload *r, const char *path, size_t nreaders, enum duplicates policy);
+int reload_update(struct reload *r);
+size_t reload_collect(struct reload *r);
+void reload_destroy(struct reload *r);
+
+/*
+ * Enter a read-side section as reader number reader, and get the current
+ * version.  It stays valid until the reader leaves the section.
+ */
+static inline const struct reload_version *
+reload_enter(struct reload *r, size_t reader)
+{
+    /*
+     * The epoch is announced before the pointer is read, both sequentially
+     * consistent, so a reloader which has not seen the announcement when it
+     * checks the readers had already published the version read here.
+     */
+    atomic_store(&r->readers[reader].epoch, atomic_load(&r->epoch));
+    return atomic_load(&r->current);
+}
+
+static inline void
+reload_leave(struct reload *r, size_t reader)
+{
+    atomic_store_explicit(&r->readers[reader].epoch, 0, memory_order_release);
+}
+
+#endif
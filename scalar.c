@@ -0,0 +1,153 @@
+/*
+ * Conversion of yaml scalars to c values.
+ *
+ * Booleans are recognized by dispatching on the length of the scalar, so at
+ * most three candidate spellings are compared.  Integers are validated as
+ * they are converted, and runs of eight digits are converted at once with
+ * 64-bit arithmetic on the packed characters.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "scalar.h"
+
+/* Compare a scalar to the three usual capitalizations of a word. */
+static bool
+is_word(const char *s, size_t length, const char *lower, const char *title, const char *upper)
+{
+    return memcmp(s, lower, length) == 0 ||
+           memcmp(s, title, length) == 0 ||
+           memcmp(s, upper, length) == 0;
+}
+
+/*
+ * Convert a yaml boolean string to a boolean value (true|false).
+ */
+int
+scalar_to_boolean(const char *s, size_t length, bool *value)
+{
+    switch (length) {
+    case 1:
+        if (s[0] == 'y' || s[0] == 'Y') {
+            *value = true;
+            return 0;
+        }
+        if (s[0] == 'n' || s[0] == 'N') {
+            *value = false;
+            return 0;
+        }
+        break;
+    case 2:
+        if (is_word(s, length, "on", "On", "ON")) {
+            *value = true;
+            return 0;
+        }
+        if (is_word(s, length, "no", "No", "NO")) {
+            *value = false;
+            return 0;
+        }
+        break;
+    case 3:
+        if (is_word(s, length, "yes", "Yes", "YES")) {
+            *value = true;
+            return 0;
+        }
+        if (is_word(s, length, "off", "Off", "OFF")) {
+            *value = false;
+            return 0;
+        }
+        break;
+    case 4:
+        if (is_word(s, length, "true", "True", "TRUE")) {
+            *value = true;
+            return 0;
+        }
+        break;
+    case 5:
+        if (is_word(s, length, "false", "False", "FALSE")) {
+            *value = false;
+            return 0;
+        }
+        break;
+    }
+    return EINVAL;
+}
+
+/*
+ * Convert eight decimal digits packed in a little endian word, or return
+ * UINT64_MAX if they are not all digits.
+ */
+static inline uint64_t
+parse_eight_digits(const char *s)
+{
+    uint64_t x;
+
+    memcpy(&x, s, sizeof(x));
+    /* Each byte must be 0x30 to 0x39. */
+    if (((x & 0xf0f0f0f0f0f0f0f0ull) | (((x + 0x0606060606060606ull) & 0xf0f0f0f0f0f0f0f0ull) >> 4)) !=
+        0x3333333333333333ull) {
+        return UINT64_MAX;
+    }
+    x -= 0x3030303030303030ull;
+    x = (x * 10) + (x >> 8);
+    x = (((x & 0x000000ff000000ffull) * (100 + (1000000ull << 32))) +
+         (((x >> 16) & 0x000000ff000000ffull) * (1 + (10000ull << 32)))) >> 32;
+    return x;
+}
+
+/*
+ * Convert a decimal integer string, with an optional sign, to a 64-bit value.
+ * Returns EINVAL if the string is not an integer and ERANGE if the value does
+ * not fit.
+ */
+int
+scalar_to_int64(const char *s, size_t length, int64_t *value)
+{
+    const char *end = s + length;
+    bool negative = false;
+    uint64_t n = 0;
+    uint64_t limit;
+
+    if (s < end && (*s == '-' || *s == '+')) {
+        negative = (*s == '-');
+        s++;
+    }
+    if (s == end) {
+        return EINVAL;
+    }
+    while (s < end - 1 && *s == '0') {
+        s++;
+    }
+    /* 10^19 - 1 is the largest run of digits which cannot overflow. */
+    if (end - s > 19) {
+        for (; s < end; s++) {
+            if (*s < '0' || *s > '9') {
+                return EINVAL;
+            }
+        }
+        return ERANGE;
+    }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (end - s >= 8) {
+        uint64_t digits = parse_eight_digits(s);
+        if (digits == UINT64_MAX) {
+            return EINVAL;
+        }
+        n = n * 100000000 + digits;
+        s += 8;
+    }
+#endif
+    for (; s < end; s++) {
+        if (*s < '0' || *s > '9') {
+            return EINVAL;
+        }
+        n = n * 10 + (*s - '0');
+    }
+    limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    if (n > limit) {
+        return ERANGE;
+    }
+    *value = negative ? (int64_t)(0 - n) : (int64_t)n;
+    return 0;
+}
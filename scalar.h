@@ -0,0 +1,19 @@
+/*
+ * Conversion of yaml scalars to c values.
+ *
+ * The conversions take the scalar length reported by libyaml, so they do not
+ * need to scan for the terminating nul, and they return 0 on success or an
+ * errno value on failure.
+ */
+
+#ifndef SCALAR_H
+#define SCALAR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+int scalar_to_boolean(const char *s, size_t length, bool *value);
+int scalar_to_int64(const char *s, size_t length, int64_t *value);
+
+#endif
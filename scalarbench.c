@@ -0,0 +1,166 @@
+/*
+ * Scalar conversion microbenchmarks.
+ *
+ * Compare the conversions in scalar.c with the atoi() and strcmp() based
+ * conversions the parser used before.
+ *
+ *     $ make scalarbench
+ *     $ ./scalarbench
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "scalar.h"
+
+#define NVALUES 4096
+#define ROUNDS 2000
+
+/* The original strcmp() based boolean conversion. */
+int
+get_boolean(const char *string, bool *value)
+{
+    char *t[] = {"y", "Y", "yes", "Yes", "YES", "true", "True", "TRUE", "on", "On", "ON", NULL};
+    char *f[] = {"n", "N", "no", "No", "NO", "false", "False", "FALSE", "off", "Off", "OFF", NULL};
+    char **p;
+
+    for (p = t; *p; p++) {
+        if (strcmp(string, *p) == 0) {
+            *value = true;
+            return 0;
+        }
+    }
+    for (p = f; *p; p++) {
+        if (strcmp(string, *p) == 0) {
+            *value = false;
+            return 0;
+        }
+    }
+    return EINVAL;
+}
+
+struct sample {
+    char string[24];
+    size_t length;
+};
+
+static struct sample samples[NVALUES];
+
+double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void
+report(const char *name, double start, unsigned long sum)
+{
+    double ns = (now() - start) * 1e9 / ((double)NVALUES * ROUNDS);
+    printf("%-28s %8.2f ns/value  (checksum %lu)\n", name, ns, sum);
+}
+
+/* Fill the samples with integers of up to the given number of digits. */
+void
+make_integers(int digits)
+{
+    for (int i = 0; i < NVALUES; i++) {
+        int n = 1 + rand() % digits;
+        for (int j = 0; j < n; j++) {
+            samples[i].string[j] = '0' + (j ? rand() % 10 : 1 + rand() % 9);
+        }
+        samples[i].string[n] = '\0';
+        samples[i].length = n;
+    }
+}
+
+void
+make_booleans(void)
+{
+    const char *words[] = {"true", "false", "yes", "no", "True", "False", "off", "ON", "y", "N"};
+
+    for (int i = 0; i < NVALUES; i++) {
+        strcpy(samples[i].string, words[rand() % 10]);
+        samples[i].length = strlen(samples[i].string);
+    }
+}
+
+void
+bench_integers(int digits)
+{
+    char name[64];
+    double start;
+    unsigned long sum;
+
+    make_integers(digits);
+
+    snprintf(name, sizeof(name), "atoi, %d digits", digits);
+    sum = 0;
+    start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < NVALUES; i++) {
+            sum += atoll(samples[i].string);
+        }
+    }
+    report(name, start, sum);
+
+    snprintf(name, sizeof(name), "scalar_to_int64, %d digits", digits);
+    sum = 0;
+    start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < NVALUES; i++) {
+            int64_t value;
+            if (scalar_to_int64(samples[i].string, samples[i].length, &value) == 0) {
+                sum += value;
+            }
+        }
+    }
+    report(name, start, sum);
+}
+
+void
+bench_booleans(void)
+{
+    double start;
+    unsigned long sum;
+
+    make_booleans();
+
+    sum = 0;
+    start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < NVALUES; i++) {
+            bool value;
+            if (get_boolean(samples[i].string, &value) == 0) {
+                sum += value;
+            }
+        }
+    }
+    report("get_boolean", start, sum);
+
+    sum = 0;
+    start = now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < NVALUES; i++) {
+            bool value;
+            if (scalar_to_boolean(samples[i].string, samples[i].length, &value) == 0) {
+                sum += value;
+            }
+        }
+    }
+    report("scalar_to_boolean", start, sum);
+}
+
+int
+main(int argc, char *argv[])
+{
+    srand(1);
+    bench_integers(3);
+    bench_integers(9);
+    bench_integers(18);
+    bench_booleans();
+    return EXIT_SUCCESS;
+}
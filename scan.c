@@ -4,21 +4,83 @@
  * This is a simple libyaml parser example which scans and prints
  * the libyaml parser events.
  *
+ * With --stats, no events are printed; only counts per event type, the
+ * maximum nesting depth, the total scalar bytes and the rate are reported.
+ *
+ * With --tape FILE, the events are recorded to a binary tape (tape.h)
+ * instead of printed, which parse --tape can load without parsing the yaml
+ * again.  --marks adds the line and column of each event to the tape.
  */
 #include <yaml.h>
+#include <errno.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "input.h"
+#include "output.h"
+#include "tape.h"
 
 #define INDENT "  "
 #define STRVAL(x) ((x) ? (char*)(x) : "")
 
+/* Event lines are formatted straight into a large output buffer. */
+static struct output out;
+
+#define EVENT_TYPES (YAML_MAPPING_END_EVENT + 1)
+
+static const char *event_names[EVENT_TYPES] = {
+    [YAML_NO_EVENT] = "no-event",
+    [YAML_STREAM_START_EVENT] = "stream-start-event",
+    [YAML_STREAM_END_EVENT] = "stream-end-event",
+    [YAML_DOCUMENT_START_EVENT] = "document-start-event",
+    [YAML_DOCUMENT_END_EVENT] = "document-end-event",
+    [YAML_ALIAS_EVENT] = "alias-event",
+    [YAML_SCALAR_EVENT] = "scalar-event",
+    [YAML_SEQUENCE_START_EVENT] = "sequence-start-event",
+    [YAML_SEQUENCE_END_EVENT] = "sequence-end-event",
+    [YAML_MAPPING_START_EVENT] = "mapping-start-event",
+    [YAML_MAPPING_END_EVENT] = "mapping-end-event",
+};
+
+/* Event statistics, for --stats. */
+struct stats {
+    unsigned long count[EVENT_TYPES];
+    int depth;
+    int max_depth;
+    size_t scalar_bytes;
+};
+
+void put_string(const char *s)
+{
+    output_put(&out, s, strlen(s));
+}
+
+void put_number(unsigned long n)
+{
+    char digits[24];
+    char *p = digits + sizeof(digits);
+
+    do {
+        *--p = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    output_put(&out, p, digits + sizeof(digits) - p);
+}
+
 void indent(int level)
 {
-    int i;
-    for (i = 0; i < level; i++) {
-        printf("%s", INDENT);
+    static const char spaces[] = INDENT INDENT INDENT INDENT INDENT INDENT INDENT INDENT;
+    size_t n = level * (sizeof(INDENT) - 1);
+
+    while (n > sizeof(spaces) - 1) {
+        output_put(&out, spaces, sizeof(spaces) - 1);
+        n -= sizeof(spaces) - 1;
     }
+    output_put(&out, spaces, n);
 }
 
 void print_event(yaml_event_t *event)
@@ -26,58 +88,96 @@ void print_event(yaml_event_t *event)
     static int level = 0;
 
     switch (event->type) {
-    case YAML_NO_EVENT:
-        indent(level);
-        printf("no-event (%d)\n", event->type);
-        break;
-    case YAML_STREAM_START_EVENT:
-        indent(level++);
-        printf("stream-start-event (%d)\n", event->type);
-        break;
     case YAML_STREAM_END_EVENT:
-        indent(--level);
-        printf("stream-end-event (%d)\n", event->type);
-        break;
-    case YAML_DOCUMENT_START_EVENT:
-        indent(level++);
-        printf("document-start-event (%d)\n", event->type);
-        break;
     case YAML_DOCUMENT_END_EVENT:
-        indent(--level);
-        printf("document-end-event (%d)\n", event->type);
-        break;
-    case YAML_ALIAS_EVENT:
-        indent(level);
-        printf("alias-event (%d)\n", event->type);
+    case YAML_SEQUENCE_END_EVENT:
+    case YAML_MAPPING_END_EVENT:
+        level--;
         break;
-    case YAML_SCALAR_EVENT:
-        indent(level);
-        printf("scalar-event (%d) = {value=\"%s\", length=%d}\n",
-               event->type,
-               STRVAL(event->data.scalar.value),
-               (int)event->data.scalar.length);
+    default:
         break;
+    }
+    if (level < 0) {
+        fprintf(stderr, "indentation underflow!\n");
+        level = 0;
+    }
+    indent(level);
+    put_string(event_names[event->type]);
+    put_string(" (");
+    put_number(event->type);
+    if (event->type == YAML_SCALAR_EVENT) {
+        put_string(") = {value=\"");
+        put_string(STRVAL(event->data.scalar.value));
+        put_string("\", length=");
+        put_number((int)event->data.scalar.length);
+        put_string("}\n");
+    } else {
+        put_string(")\n");
+    }
+    switch (event->type) {
+    case YAML_STREAM_START_EVENT:
+    case YAML_DOCUMENT_START_EVENT:
     case YAML_SEQUENCE_START_EVENT:
-        indent(level++);
-        printf("sequence-start-event (%d)\n", event->type);
+    case YAML_MAPPING_START_EVENT:
+        level++;
         break;
-    case YAML_SEQUENCE_END_EVENT:
-        indent(--level);
-        printf("sequence-end-event (%d)\n", event->type);
+    default:
         break;
+    }
+}
+
+void count_event(struct stats *stats, yaml_event_t *event)
+{
+    stats->count[event->type]++;
+    switch (event->type) {
+    case YAML_STREAM_START_EVENT:
+    case YAML_DOCUMENT_START_EVENT:
+    case YAML_SEQUENCE_START_EVENT:
     case YAML_MAPPING_START_EVENT:
-        indent(level++);
-        printf("mapping-start-event (%d)\n", event->type);
+        if (++stats->depth > stats->max_depth) {
+            stats->max_depth = stats->depth;
+        }
         break;
+    case YAML_STREAM_END_EVENT:
+    case YAML_DOCUMENT_END_EVENT:
+    case YAML_SEQUENCE_END_EVENT:
     case YAML_MAPPING_END_EVENT:
-        indent(--level);
-        printf("mapping-end-event (%d)\n", event->type);
+        stats->depth--;
+        break;
+    case YAML_SCALAR_EVENT:
+        stats->scalar_bytes += event->data.scalar.length;
+        break;
+    default:
         break;
     }
-    if (level < 0) {
-        fprintf(stderr, "indentation underflow!\n");
-        level = 0;
+}
+
+void print_stats(struct stats *stats, size_t bytes, double seconds)
+{
+    unsigned long events = 0;
+    int i;
+
+    for (i = 0; i < EVENT_TYPES; i++) {
+        events += stats->count[i];
+    }
+    for (i = 1; i < EVENT_TYPES; i++) {
+        printf("%-22s %lu\n", event_names[i], stats->count[i]);
     }
+    printf("%-22s %lu\n", "events", events);
+    printf("%-22s %d\n", "max-depth", stats->max_depth);
+    printf("%-22s %zu\n", "scalar-bytes", stats->scalar_bytes);
+    printf("%-22s %zu\n", "input-bytes", bytes);
+    printf("%-22s %.3f\n", "seconds", seconds);
+    if (seconds > 0) {
+        printf("%-22s %.0f\n", "events/sec", events / seconds);
+        printf("%-22s %.1f\n", "MB/sec", bytes / seconds / 1e6);
+    }
+}
+
+void usage(void)
+{
+    fprintf(stderr, "usage: scan [--stats] [--tape FILE [--marks]] [input.yaml]\n");
+    exit(EXIT_FAILURE);
 }
 
 int main(int argc, char *argv[])
@@ -85,23 +185,115 @@ int main(int argc, char *argv[])
     yaml_parser_t parser;
     yaml_event_t event;
     yaml_event_type_t event_type;
+    struct input input;
+    struct stats stats;
+    struct output tape;
+    struct timespec start, end;
+    const char *path = NULL;
+    const char *tape_path = NULL;
+    int tape_flags = 0;
+    int show_stats = 0;
+    int status = EXIT_SUCCESS;
+    int error;
+    struct option options[] = {
+        {"stats", no_argument, NULL, 's'},
+        {"tape", required_argument, NULL, 't'},
+        {"marks", no_argument, NULL, 'm'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
 
+    while ((opt = getopt_long(argc, argv, "st:m", options, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            show_stats = 1;
+            break;
+        case 't':
+            tape_path = optarg;
+            break;
+        case 'm':
+            tape_flags |= TAPE_MARKS;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind < argc - 1 || (tape_flags && !tape_path)) {
+        usage();
+    }
+    memset(&stats, 0, sizeof(stats));
     yaml_parser_initialize(&parser);
-    yaml_parser_set_input_file(&parser, stdin);
+    if (optind < argc) {
+        /* Read the file in place, instead of through stdio. */
+        path = argv[optind];
+        if ((error = input_map(&input, path))) {
+            fprintf(stderr, "%s: %s\n", path, strerror(error));
+            yaml_parser_delete(&parser);
+            return EXIT_FAILURE;
+        }
+        yaml_parser_set_input_string(&parser, input.data, input.size);
+    } else {
+        yaml_parser_set_input_file(&parser, stdin);
+    }
+    if (tape_path) {
+        if ((error = output_open(&tape, tape_path, 0, -1, 0)) ||
+            (error = tape_write_header(&tape, tape_flags))) {
+            fprintf(stderr, "%s: %s\n", tape_path, strerror(error));
+            yaml_parser_delete(&parser);
+            if (path) {
+                input_close(&input);
+            }
+            return EXIT_FAILURE;
+        }
+    } else if (!show_stats && (error = output_open_fd(&out, STDOUT_FILENO, 0))) {
+        fprintf(stderr, "stdout: %s\n", strerror(error));
+        yaml_parser_delete(&parser);
+        if (path) {
+            input_close(&input);
+        }
+        return EXIT_FAILURE;
+    }
 
+    clock_gettime(CLOCK_MONOTONIC, &start);
     do {
-        if (!yaml_parser_parse(&parser, &event))
-            goto error;
-        print_event(&event);
+        if (!yaml_parser_parse(&parser, &event)) {
+            /* Write the events scanned so far before the error. */
+            if (!show_stats && !tape_path) {
+                output_flush(&out);
+            }
+            fprintf(stderr, "Failed to parse: %s\n", parser.problem);
+            status = EXIT_FAILURE;
+            break;
+        }
+        if (tape_path) {
+            tape_write_event(&tape, &event, tape_flags);
+        }
+        if (show_stats) {
+            count_event(&stats, &event);
+        } else if (!tape_path) {
+            print_event(&event);
+        }
         event_type = event.type;
         yaml_event_delete(&event);
     } while (event_type != YAML_STREAM_END_EVENT);
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
+    if (show_stats && status == EXIT_SUCCESS) {
+        print_stats(&stats, parser.offset,
+                    (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    }
+    if (tape_path) {
+        if ((error = output_close(&tape))) {
+            fprintf(stderr, "%s: %s\n", tape_path, strerror(error));
+            status = EXIT_FAILURE;
+        }
+    } else if (!show_stats && (error = output_close(&out))) {
+        fprintf(stderr, "stdout: %s\n", strerror(error));
+        status = EXIT_FAILURE;
+    }
     yaml_parser_delete(&parser);
-    return EXIT_SUCCESS;
-
-error:
-    fprintf(stderr, "Failed to parse: %s\n", parser.problem);
-    yaml_parser_delete(&parser);
-    return EXIT_FAILURE;
+    if (path) {
+        input_close(&input);
+    }
+    return status;
 }
@@ -0,0 +1,289 @@
+/*
+ * Binary snapshots of a loaded catalog.  The format is described in
+ * snapshot.h.
+ *
+ * A snapshot is written to a temporary file which is then renamed over the
+ * old one, so a process starting meanwhile sees either the old snapshot or
+ * the new one, never a partial one.  When it is opened, every offset and
+ * index in it is checked once, so the records can then be used without
+ * further checks.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+#include "hash.h"
+#include "names.h"
+#include "output.h"
+
+#define TEMPORARY_SUFFIX ".tmp"
+
+/* The string pool being built, with the offset of each distinct string. */
+struct pool {
+    uint64_t *offsets;      /* Offset plus one of the string in each slot. */
+    size_t mask;
+    char *bytes;
+    size_t used;
+    size_t size;
+};
+
+static void
+pool_init(struct pool *p, size_t nstrings)
+{
+    size_t slots = 16;
+
+    while (slots < 2 * nstrings) {
+        slots *= 2;
+    }
+    memset(p, 0, sizeof(*p));
+    p->offsets = bail_alloc(slots * sizeof(*p->offsets));
+    p->mask = slots - 1;
+}
+
+/* Add a string to the pool, once, and return its offset. */
+static uint64_t
+pool_add(struct pool *p, const char *s)
+{
+    size_t length = strlen(s) + 1;
+    size_t i = hash_bytes((const unsigned char *)s, length) & p->mask;
+
+    for (; p->offsets[i]; i = (i + 1) & p->mask) {
+        if (memcmp(p->bytes + p->offsets[i] - 1, s, length) == 0) {
+            return p->offsets[i] - 1;
+        }
+    }
+    while (p->used + length > p->size) {
+        p->size = p->size ? p->size * 2 : 65536;
+        p->bytes = bail_realloc(p->bytes, p->size);
+    }
+    memcpy(p->bytes + p->used, s, length);
+    p->offsets[i] = p->used + 1;
+    p->used += length;
+    return p->offsets[i] - 1;
+}
+
+static void
+pool_destroy(struct pool *p)
+{
+    bail_free(ALLOC_OTHER, p->offsets);
+    bail_free(ALLOC_OTHER, p->bytes);
+}
+
+static uint64_t
+mtime_ns(const struct stat *st)
+{
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/*
+ * Build the records and string pool of a snapshot of a catalog.  The
+ * catalog must have no unparsed varieties.  Returns 0 on success or EINVAL.
+ */
+int
+snapshot_build(struct snapshot_image *image, const struct catalog *c)
+{
+    struct pool pool;
+
+    memset(image, 0, sizeof(*image));
+    for (size_t i = 0; i < c->nfruits; i++) {
+        if (c->fruits[i].unparsed) {
+            return EINVAL;
+        }
+    }
+    pool_init(&pool, 2 * (c->nfruits + c->nvarieties));
+    image->fruits = bail_alloc((c->nfruits + 1) * sizeof(*image->fruits));
+    image->varieties = bail_alloc((c->nvarieties + 1) * sizeof(*image->varieties));
+    for (size_t i = 0; i < c->nfruits; i++) {
+        const struct catalog_fruit *f = &c->fruits[i];
+        struct snapshot_fruit *r = &image->fruits[i];
+
+        r->name = pool_add(&pool, f->name);
+        r->color = pool_add(&pool, f->color);
+        r->count = f->count;
+        r->variety = f->variety;
+        r->nvarieties = f->nvarieties;
+    }
+    for (size_t i = 0; i < c->nvarieties; i++) {
+        const struct catalog_variety *v = &c->varieties[i];
+        struct snapshot_variety *r = &image->varieties[i];
+
+        r->name = pool_add(&pool, v->name);
+        r->color = pool_add(&pool, v->color);
+        r->seedless = v->seedless;
+    }
+    image->nfruits = c->nfruits;
+    image->nvarieties = c->nvarieties;
+    image->strings = pool.bytes;
+    image->strings_size = pool.used;
+    pool.bytes = NULL;
+    pool_destroy(&pool);
+    return 0;
+}
+
+void
+snapshot_image_destroy(struct snapshot_image *image)
+{
+    bail_free(ALLOC_OTHER, image->fruits);
+    bail_free(ALLOC_OTHER, image->varieties);
+    bail_free(ALLOC_OTHER, image->strings);
+    memset(image, 0, sizeof(*image));
+}
+
+/*
+ * Write a snapshot of a catalog loaded from the yaml file at path, whose
+ * contents are given.  The catalog must have no unparsed varieties.
+ * Returns 0 on success or an errno value.
+ */
+int
+snapshot_write(const struct catalog *c, const char *path, const unsigned char *data, size_t size,
+               const char *snapshot_path)
+{
+    struct snapshot_header header;
+    struct snapshot_image image;
+    struct output out;
+    struct stat st;
+    char *temporary;
+    size_t fruits_size;
+    size_t varieties_size;
+    int error;
+
+    if (stat(path, &st) < 0) {
+        return errno;
+    }
+    if ((error = snapshot_build(&image, c))) {
+        return error;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.source_size = st.st_size;
+    header.source_mtime = mtime_ns(&st);
+    header.source_hash = hash_bytes(data, size);
+    header.duplicates = c->names ? c->names->policy + 1 : 0;
+    header.nfruits = image.nfruits;
+    header.nvarieties = image.nvarieties;
+    header.strings_size = image.strings_size;
+    fruits_size = image.nfruits * sizeof(*image.fruits);
+    varieties_size = image.nvarieties * sizeof(*image.varieties);
+
+    temporary = bail_alloc(strlen(snapshot_path) + sizeof(TEMPORARY_SUFFIX));
+    strcpy(temporary, snapshot_path);
+    strcat(temporary, TEMPORARY_SUFFIX);
+    if ((error = output_open(&out, temporary, 0,
+                             sizeof(header) + fruits_size + varieties_size + image.strings_size, 0))) {
+        goto done;
+    }
+    output_write(&out, &header, sizeof(header));
+    output_write(&out, image.fruits, fruits_size);
+    output_write(&out, image.varieties, varieties_size);
+    output_write(&out, image.strings, image.strings_size);
+    if ((error = output_close(&out))) {
+        remove(temporary);
+    } else if (rename(temporary, snapshot_path) < 0) {
+        error = errno;
+        remove(temporary);
+    }
+
+done:
+    bail_free(ALLOC_OTHER, temporary);
+    snapshot_image_destroy(&image);
+    return error;
+}
+
+/* Check the records of a snapshot, so they can be used without checks. */
+static int
+check_records(const struct snapshot *snap)
+{
+    uint64_t strings = snap->header->strings_size;
+
+    for (size_t i = 0; i < snap->nfruits; i++) {
+        const struct snapshot_fruit *f = &snap->fruits[i];
+
+        if (f->name >= strings || f->color >= strings ||
+            f->variety > snap->nvarieties || f->nvarieties > snap->nvarieties - f->variety) {
+            return 0;
+        }
+    }
+    for (size_t i = 0; i < snap->nvarieties; i++) {
+        const struct snapshot_variety *v = &snap->varieties[i];
+
+        if (v->name >= strings || v->color >= strings) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Open the snapshot of the yaml file at path, whose contents are given, for
+ * a load with a duplicates policy, or -1 for a load without a name index.
+ * Returns 0 on success, EINVAL if the snapshot is not valid, ESTALE if the
+ * yaml file has changed since it was written or it was written with another
+ * policy, or another errno value.
+ */
+int
+snapshot_open(struct snapshot *snap, const char *snapshot_path, const char *path,
+              const unsigned char *data, size_t size, int duplicates)
+{
+    const struct snapshot_header *h;
+    struct stat st;
+    size_t records;
+    int error;
+
+    memset(snap, 0, sizeof(*snap));
+    if ((error = input_map(&snap->input, snapshot_path))) {
+        return error;
+    }
+    h = (const struct snapshot_header *)snap->input.data;
+    if (snap->input.size < sizeof(*h) || memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != SNAPSHOT_VERSION || h->byte_order != SNAPSHOT_BYTE_ORDER ||
+        h->nfruits > snap->input.size / sizeof(struct snapshot_fruit) ||
+        h->nvarieties > snap->input.size / sizeof(struct snapshot_variety)) {
+        error = EINVAL;
+        goto fail;
+    }
+    records = h->nfruits * sizeof(struct snapshot_fruit) + h->nvarieties * sizeof(struct snapshot_variety);
+    if (snap->input.size - sizeof(*h) < records ||
+        snap->input.size - sizeof(*h) - records != h->strings_size ||
+        (h->strings_size > 0 && snap->input.data[snap->input.size - 1] != '\0')) {
+        error = EINVAL;
+        goto fail;
+    }
+    if (stat(path, &st) < 0) {
+        error = errno;
+        goto fail;
+    }
+    if (h->source_size != (uint64_t)st.st_size || h->source_size != size ||
+        h->source_mtime != mtime_ns(&st) || h->source_hash != hash_bytes(data, size) ||
+        h->duplicates != (uint64_t)(duplicates + 1)) {
+        error = ESTALE;
+        goto fail;
+    }
+    snap->header = h;
+    snap->fruits = (const struct snapshot_fruit *)(h + 1);
+    snap->nfruits = h->nfruits;
+    snap->varieties = (const struct snapshot_variety *)(snap->fruits + snap->nfruits);
+    snap->nvarieties = h->nvarieties;
+    snap->strings = (const char *)(snap->varieties + snap->nvarieties);
+    if (!check_records(snap)) {
+        error = EINVAL;
+        goto fail;
+    }
+    return 0;
+
+fail:
+    input_close(&snap->input);
+    memset(snap, 0, sizeof(*snap));
+    return error;
+}
+
+void
+snapshot_close(struct snapshot *snap)
+{
+    input_close(&snap->input);
+    memset(snap, 0, sizeof(*snap));
+}
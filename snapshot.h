@@ -0,0 +1,98 @@
+/*
+ * Binary snapshots of a loaded catalog.
+ *
+ * A snapshot is a flat image of a catalog which is mapped and used in
+ * place, without parsing or allocating anything per record.  It starts with
+ * a header (struct snapshot_header), followed by the fruit records, the
+ * variety records, and a pool of NUL-terminated strings.  Records refer to
+ * strings by their offset in the pool and to varieties by their index, so
+ * the image can be mapped at any address.  Each distinct string is stored
+ * once.
+ *
+ * The same records can also be compiled into a program; see yaml2c.c.
+ *
+ * The header records the size, modification time and hash (hash.h) of the
+ * yaml file the catalog was loaded from, so a snapshot is only used while
+ * the file is unchanged.  It also records the duplicates policy of the name
+ * index the catalog was loaded with (names.h), which changes the catalog,
+ * so a snapshot is only used by a load with the same policy.  All numbers
+ * are in host byte order, which the header also records.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fruit.h"
+#include "input.h"
+
+#define SNAPSHOT_MAGIC "YAMLSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+#define SNAPSHOT_SUFFIX ".snap"
+
+struct snapshot_header {
+    char magic[8];              /* SNAPSHOT_MAGIC, not NUL-terminated. */
+    uint32_t version;
+    uint32_t byte_order;        /* SNAPSHOT_BYTE_ORDER as written. */
+    uint64_t source_size;       /* Size of the yaml file. */
+    uint64_t source_mtime;      /* Modification time of the yaml file, in ns. */
+    uint64_t source_hash;       /* Hash of the yaml file. */
+    uint64_t duplicates;        /* Duplicates policy plus one, 0 without a name index. */
+    uint64_t nfruits;
+    uint64_t nvarieties;
+    uint64_t strings_size;      /* Bytes in the string pool. */
+};
+
+struct snapshot_fruit {
+    uint64_t name;              /* Offset in the string pool. */
+    uint64_t color;
+    int64_t count;
+    uint64_t variety;           /* Index of the first variety. */
+    uint64_t nvarieties;
+};
+
+struct snapshot_variety {
+    uint64_t name;
+    uint64_t color;
+    uint64_t seedless;
+};
+
+struct snapshot {
+    const struct snapshot_header *header;
+    const struct snapshot_fruit *fruits;
+    size_t nfruits;
+    const struct snapshot_variety *varieties;
+    size_t nvarieties;
+    const char *strings;
+    struct input input;         /* The mapped snapshot. */
+};
+
+/* The records and strings of a snapshot, built in memory. */
+struct snapshot_image {
+    struct snapshot_fruit *fruits;
+    size_t nfruits;
+    struct snapshot_variety *varieties;
+    size_t nvarieties;
+    char *strings;
+    size_t strings_size;
+};
+
+int snapshot_build(struct snapshot_image *image, const struct catalog *c);
+void snapshot_image_destroy(struct snapshot_image *image);
+int snapshot_write(const struct catalog *c, const char *path, const unsigned char *data, size_t size,
+                   const char *snapshot_path);
+int snapshot_open(struct snapshot *snap, const char *snapshot_path, const char *path,
+                  const unsigned char *data, size_t size, int duplicates);
+void snapshot_close(struct snapshot *snap);
+
+/* Get a string of the snapshot. */
+static inline const char *
+snapshot_string(const struct snapshot *snap, uint64_t offset)
+{
+    return snap->strings + offset;
+}
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * Split a yaml stream at document boundaries.
+ *
+ * A document start marker "---" at the start of a line always begins a new
+ * document; yaml does not allow it as content, not even within a block
+ * scalar.  So the stream can be split into documents by looking at the
+ * first bytes of each line, without parsing it.  Directives ("%YAML") which
+ * precede a marker belong to the document which follows them.
+ *
+ * Each span is a complete yaml stream which can be parsed on its own.
+ */
+
+#include <string.h>
+
+#include "split.h"
+#include "fruit.h"
+
+/* Check for a document start marker at the start of a line. */
+static int
+is_document_start(const unsigned char *p, const unsigned char *end)
+{
+    return end - p >= 3 && p[0] == '-' && p[1] == '-' && p[2] == '-' &&
+           (end - p == 3 || p[3] == ' ' || p[3] == '\t' || p[3] == '\r' || p[3] == '\n');
+}
+
+static void
+add_span(struct span **spans, size_t *n, size_t offset, size_t length)
+{
+    /* Grow in powers of two. */
+    if ((*n & (*n - 1)) == 0) {
+        *spans = bail_realloc(*spans, (*n ? *n * 2 : 1) * sizeof(**spans));
+    }
+    (*spans)[*n].offset = offset;
+    (*spans)[*n].length = length;
+    (*n)++;
+}
+
+/*
+ * Find the documents of a stream.  Returns the number of spans, which is at
+ * least one, and sets spans to a new array of them.
+ */
+size_t
+split_documents(const unsigned char *data, size_t size, struct span **spans)
+{
+    const unsigned char *end = data + size;
+    const unsigned char *line;
+    const unsigned char *next;
+    size_t start = 0;            /* Start of the current document. */
+    size_t directives = size;    /* Start of directives before a marker. */
+    int content = 0;             /* Current document has content. */
+    size_t n = 0;
+
+    *spans = NULL;
+    for (line = data; line < end; line = next) {
+        next = memchr(line, '\n', end - line);
+        next = next ? next + 1 : end;
+
+        if (is_document_start(line, end)) {
+            size_t split = directives < size ? directives : (size_t)(line - data);
+            if (content) {
+                add_span(spans, &n, start, split - start);
+                start = split;
+            }
+            content = 1;
+            directives = size;
+        } else if (line[0] == '%') {
+            if (directives == size) {
+                directives = line - data;
+            }
+        } else if (line[0] != '#' && line[0] != '\n' && line[0] != '\r') {
+            content = 1;
+            directives = size;
+        }
+    }
+    if (content || n == 0) {
+        add_span(spans, &n, start, size - start);
+    } else {
+        /* Trailing comments belong to the last document. */
+        (*spans)[n - 1].length = size - (*spans)[n - 1].offset;
+    }
+    return n;
+}
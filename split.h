@@ -0,0 +1,18 @@
+/*
+ * Split a yaml stream at document boundaries.
+ */
+
+#ifndef SPLIT_H
+#define SPLIT_H
+
+#include <stddef.h>
+
+/* A range of bytes of the input. */
+struct span {
+    size_t offset;
+    size_t length;
+};
+
+size_t split_documents(const unsigned char *data, size_t size, struct span **spans);
+
+#endif
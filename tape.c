@@ -0,0 +1,81 @@
+/*
+ * Binary event tapes.  The format is described in tape.h.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "tape.h"
+
+/* Append a varint to a buffer and return its length. */
+static size_t
+put_varint(unsigned char *p, size_t value)
+{
+    size_t n = 0;
+
+    while (value >= 0x80) {
+        p[n++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    p[n++] = value;
+    return n;
+}
+
+/*
+ * Write the tape header.  Returns 0 on success or an errno value.
+ */
+int
+tape_write_header(struct output *out, int flags)
+{
+    unsigned char header[TAPE_HEADER_SIZE];
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, TAPE_MAGIC, 8);
+    header[8] = TAPE_VERSION;
+    header[9] = flags;
+    return output_put(out, header, sizeof(header));
+}
+
+/*
+ * Write an event.  Returns 0 on success or an errno value.
+ */
+int
+tape_write_event(struct output *out, const yaml_event_t *event, int flags)
+{
+    unsigned char head[32];
+    size_t n = 0;
+    int error;
+
+    head[n++] = event->type;
+    if (flags & TAPE_MARKS) {
+        n += put_varint(head + n, event->start_mark.line);
+        n += put_varint(head + n, event->start_mark.column);
+    }
+    if (event->type != YAML_SCALAR_EVENT) {
+        return output_put(out, head, n);
+    }
+    n += put_varint(head + n, event->data.scalar.length);
+    if ((error = output_put(out, head, n)) ||
+        (error = output_put(out, event->data.scalar.value, event->data.scalar.length))) {
+        return error;
+    }
+    return output_put(out, "", 1);
+}
+
+/*
+ * Start reading a tape.  Returns 0 on success, or EINVAL if the data is not
+ * a tape of a supported version.
+ */
+int
+tape_open(struct tape *t, const unsigned char *data, size_t size)
+{
+    memset(t, 0, sizeof(*t));
+    if (size < TAPE_HEADER_SIZE || memcmp(data, TAPE_MAGIC, 8) != 0 ||
+        data[8] != TAPE_VERSION || (data[9] & ~TAPE_MARKS)) {
+        return EINVAL;
+    }
+    t->flags = data[9];
+    t->next = data + TAPE_HEADER_SIZE;
+    t->end = data + size;
+    return 0;
+}
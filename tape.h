@@ -0,0 +1,104 @@
+/*
+ * Binary event tapes.
+ *
+ * A tape records the libyaml events of a stream so that it can be replayed
+ * without parsing the yaml again.  It starts with a 16 byte header: the
+ * magic "YAMLTAPE", a version byte, a flags byte and six zero bytes.  Then
+ * each event is a type byte, followed by the line and column of the event
+ * as varints if the TAPE_MARKS flag is set, and for scalars the length as a
+ * varint and the value bytes with a terminating NUL.  The last event is
+ * STREAM-END.
+ *
+ * Varints are little-endian base 128: seven bits per byte, with the high
+ * bit set on all bytes but the last.
+ *
+ * Tapes are read in place, usually from a mapped file.  Scalar values point
+ * into the tape, and are NUL-terminated like the ones libyaml returns.
+ * Anchors, tags and scalar styles are not recorded.
+ */
+
+#ifndef TAPE_H
+#define TAPE_H
+
+#include <yaml.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "output.h"
+
+#define TAPE_MAGIC "YAMLTAPE"
+#define TAPE_VERSION 1
+#define TAPE_HEADER_SIZE 16
+
+/* Flags. */
+#define TAPE_MARKS 0x01     /* Events have a line and column. */
+
+struct tape {
+    const unsigned char *next;  /* Next event. */
+    const unsigned char *end;   /* End of the tape. */
+    int flags;
+    const char *problem;        /* Why reading failed. */
+};
+
+int tape_write_header(struct output *out, int flags);
+int tape_write_event(struct output *out, const yaml_event_t *event, int flags);
+int tape_open(struct tape *t, const unsigned char *data, size_t size);
+
+/* Read a varint, or return 0 if it is truncated or too long. */
+static inline int
+tape_varint(struct tape *t, size_t *value)
+{
+    size_t v = 0;
+    int shift;
+
+    for (shift = 0; shift < 64 && t->next < t->end; shift += 7) {
+        unsigned char b = *t->next++;
+        v |= (size_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *value = v;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Read the next event.  Only the fields which are recorded are set, and the
+ * event must not be passed to yaml_event_delete().  Returns 1 on success and
+ * 0 on failure, like yaml_parser_parse().
+ */
+static inline int
+tape_next(struct tape *t, yaml_event_t *event)
+{
+    size_t length;
+
+    if (t->next >= t->end) {
+        t->problem = "unexpected end of tape";
+        return 0;
+    }
+    event->type = *t->next++;
+    if (event->type == YAML_NO_EVENT || event->type > YAML_MAPPING_END_EVENT) {
+        t->problem = "invalid event type";
+        return 0;
+    }
+    if (t->flags & TAPE_MARKS) {
+        if (!tape_varint(t, &event->start_mark.line) ||
+            !tape_varint(t, &event->start_mark.column)) {
+            t->problem = "invalid mark";
+            return 0;
+        }
+    }
+    if (event->type == YAML_SCALAR_EVENT) {
+        if (!tape_varint(t, &length) || length >= (size_t)(t->end - t->next) ||
+            t->next[length] != '\0') {
+            t->problem = "invalid scalar";
+            return 0;
+        }
+        event->data.scalar.value = (yaml_char_t *)t->next;
+        event->data.scalar.length = length;
+        t->next += length + 1;
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * Tracepoints and counters for the loader.  See trace.h.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "trace.h"
+
+int tracing = 0;
+
+/* The counters of all destroyed parser states. */
+static struct trace totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *state_names[STATE_COUNT] = {
+    [STATE_START] = "start",
+    [STATE_STREAM] = "stream",
+    [STATE_DOCUMENT] = "document",
+    [STATE_SECTION] = "section",
+    [STATE_FLIST] = "fruit-list",
+    [STATE_FVALUES] = "fruit-values",
+    [STATE_FKEY] = "fruit-key",
+    [STATE_FFIELD] = "fruit-field",
+    [STATE_VLIST] = "variety-list",
+    [STATE_VVALUES] = "variety-values",
+    [STATE_VKEY] = "variety-key",
+    [STATE_VFIELD] = "variety-field",
+    [STATE_SKIP] = "skip",
+    [STATE_STOP] = "stop",
+};
+
+static const char *event_names[TRACE_EVENTS] = {
+    [YAML_NO_EVENT] = "none",
+    [YAML_STREAM_START_EVENT] = "stream-start",
+    [YAML_STREAM_END_EVENT] = "stream-end",
+    [YAML_DOCUMENT_START_EVENT] = "document-start",
+    [YAML_DOCUMENT_END_EVENT] = "document-end",
+    [YAML_ALIAS_EVENT] = "alias",
+    [YAML_SCALAR_EVENT] = "scalar",
+    [YAML_SEQUENCE_START_EVENT] = "sequence-start",
+    [YAML_SEQUENCE_END_EVENT] = "sequence-end",
+    [YAML_MAPPING_START_EVENT] = "mapping-start",
+    [YAML_MAPPING_END_EVENT] = "mapping-end",
+};
+
+struct trace *
+trace_new(void)
+{
+    struct trace *t = calloc(1, sizeof(*t));
+
+    if (!t) {
+        bail("out of memory");
+    }
+    t->last = trace_now();
+    return t;
+}
+
+/*
+ * Add the counters of a parser state to the totals, and free them.
+ */
+void
+trace_merge(struct trace *t)
+{
+    pthread_mutex_lock(&totals_lock);
+    for (int i = 0; i < STATE_COUNT; i++) {
+        for (int j = 0; j < TRACE_EVENTS; j++) {
+            totals.events[i][j] += t->events[i][j];
+            totals.handle_ns[i][j] += t->handle_ns[i][j];
+        }
+        for (int j = 0; j < STATE_COUNT; j++) {
+            totals.transitions[i][j] += t->transitions[i][j];
+        }
+        totals.parse_ns[i] += t->parse_ns[i];
+    }
+    for (int i = 0; i < TRACE_LENGTHS; i++) {
+        totals.lengths[i] += t->lengths[i];
+    }
+    for (int i = 0; i < TRACE_VARIETIES; i++) {
+        totals.varieties[i] += t->varieties[i];
+    }
+    totals.fruits += t->fruits;
+    pthread_mutex_unlock(&totals_lock);
+    free(t);
+}
+
+void
+trace_parsed(struct trace *t, enum state state)
+{
+    uint64_t now = trace_now();
+
+    t->parse_ns[state] += now - t->last;
+    t->last = now;
+}
+
+void
+trace_event(struct trace *t, const yaml_event_t *event, enum state from, enum state to)
+{
+    uint64_t now = trace_now();
+
+    t->events[from][event->type]++;
+    t->handle_ns[from][event->type] += now - t->last;
+    t->transitions[from][to]++;
+    if (event->type == YAML_SCALAR_EVENT) {
+        size_t length = event->data.scalar.length;
+        int bucket = 0;
+
+        while (length > 0 && bucket < TRACE_LENGTHS - 1) {
+            length >>= 1;
+            bucket++;
+        }
+        t->lengths[bucket]++;
+    }
+    t->last = now;
+}
+
+void
+trace_fruit(struct trace *t, size_t nvarieties)
+{
+    t->fruits++;
+    t->varieties[nvarieties < TRACE_VARIETIES - 1 ? nvarieties : TRACE_VARIETIES - 1]++;
+}
+
+/*
+ * Print a summary of the totals, given the elapsed time.
+ */
+void
+trace_report(FILE *fp, double seconds)
+{
+    unsigned long events = 0;
+    unsigned long scalars = 0;
+
+    for (int i = 0; i < STATE_COUNT; i++) {
+        for (int j = 0; j < TRACE_EVENTS; j++) {
+            events += totals.events[i][j];
+        }
+    }
+    for (int i = 0; i < TRACE_LENGTHS; i++) {
+        scalars += totals.lengths[i];
+    }
+    fprintf(fp, "trace: %lu events, %lu fruits in %.3f s", events, totals.fruits, seconds);
+    if (seconds > 0) {
+        fprintf(fp, ", %.0f events/s, %.0f fruits/s", events / seconds, totals.fruits / seconds);
+    }
+    fprintf(fp, "\n\n%-16s %12s %12s %12s\n", "state", "events", "parse-ms", "handle-ms");
+    for (int i = 0; i < STATE_COUNT; i++) {
+        unsigned long n = 0;
+        uint64_t handle = 0;
+
+        for (int j = 0; j < TRACE_EVENTS; j++) {
+            n += totals.events[i][j];
+            handle += totals.handle_ns[i][j];
+        }
+        if (n > 0) {
+            fprintf(fp, "%-16s %12lu %12.1f %12.1f\n", state_names[i], n,
+                    totals.parse_ns[i] / 1e6, handle / 1e6);
+        }
+    }
+    fprintf(fp, "\n%-33s %12s\n", "transition", "count");
+    for (int i = 0; i < STATE_COUNT; i++) {
+        for (int j = 0; j < STATE_COUNT; j++) {
+            if (totals.transitions[i][j] > 0) {
+                fprintf(fp, "%-14s -> %-14s %12lu\n", state_names[i], state_names[j], totals.transitions[i][j]);
+            }
+        }
+    }
+    fprintf(fp, "\n%-16s %12s %7s\n", "scalar length", "count", "%");
+    for (int i = 0; i < TRACE_LENGTHS; i++) {
+        char range[32];
+
+        if (totals.lengths[i] == 0) {
+            continue;
+        }
+        if (i <= 1) {
+            snprintf(range, sizeof(range), "%d", i);
+        } else if (i < TRACE_LENGTHS - 1) {
+            snprintf(range, sizeof(range), "%lu-%lu", 1UL << (i - 1), (1UL << i) - 1);
+        } else {
+            snprintf(range, sizeof(range), "%lu+", 1UL << (i - 1));
+        }
+        fprintf(fp, "%-16s %12lu %7.1f\n", range, totals.lengths[i], 100.0 * totals.lengths[i] / scalars);
+    }
+    fprintf(fp, "\n%-16s %12s %7s\n", "varieties", "fruits", "%");
+    for (int i = 0; i < TRACE_VARIETIES; i++) {
+        if (totals.varieties[i] > 0) {
+            fprintf(fp, "%-3d%-13s %12lu %7.1f\n", i, i == TRACE_VARIETIES - 1 ? "+" : "",
+                    totals.varieties[i], 100.0 * totals.varieties[i] / totals.fruits);
+        }
+    }
+}
+
+/*
+ * Print the time spent in each state as folded stacks, in nanoseconds, for
+ * flamegraph.pl and similar tools.
+ */
+void
+trace_folded(FILE *fp)
+{
+    for (int i = 0; i < STATE_COUNT; i++) {
+        if (totals.parse_ns[i] > 0) {
+            fprintf(fp, "load;%s;parse %lu\n", state_names[i], (unsigned long)totals.parse_ns[i]);
+        }
+        for (int j = 0; j < TRACE_EVENTS; j++) {
+            if (totals.handle_ns[i][j] > 0) {
+                fprintf(fp, "load;%s;consume_event;%s %lu\n", state_names[i], event_names[j],
+                        (unsigned long)totals.handle_ns[i][j]);
+            }
+        }
+    }
+}
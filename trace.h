@@ -0,0 +1,76 @@
+/*
+ * Tracepoints and counters for the loader.
+ *
+ * When tracing is set, each new parser state gets a struct trace, and the
+ * tracepoints in load.c count events per state, transitions, scalar lengths
+ * and varieties per fruit, and time how long each state waits for the next
+ * event and how long the event takes to handle.  When the parser state is
+ * destroyed its counters are added to the totals, which trace_report() and
+ * trace_folded() print.
+ *
+ * While tracing is off, a tracepoint is one predictable branch.  Building
+ * with -DNO_TRACE removes the tracepoints completely.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <yaml.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "load.h"
+
+#define TRACE_EVENTS (YAML_MAPPING_END_EVENT + 1)
+#define TRACE_LENGTHS 17        /* Scalar lengths, in powers of two. */
+#define TRACE_VARIETIES 17      /* Varieties per fruit, the last is 16+. */
+
+struct trace {
+    unsigned long events[STATE_COUNT][TRACE_EVENTS];
+    uint64_t handle_ns[STATE_COUNT][TRACE_EVENTS];  /* In consume_event(). */
+    uint64_t parse_ns[STATE_COUNT];                 /* Waiting for the next event. */
+    unsigned long transitions[STATE_COUNT][STATE_COUNT];
+    unsigned long lengths[TRACE_LENGTHS];
+    unsigned long varieties[TRACE_VARIETIES];
+    unsigned long fruits;
+    uint64_t last;              /* Time of the last tracepoint. */
+};
+
+/* Set to trace the parser states created from then on. */
+extern int tracing;
+
+struct trace *trace_new(void);
+void trace_merge(struct trace *t);
+void trace_parsed(struct trace *t, enum state state);
+void trace_event(struct trace *t, const yaml_event_t *event, enum state from, enum state to);
+void trace_fruit(struct trace *t, size_t nvarieties);
+void trace_report(FILE *fp, double seconds);
+void trace_folded(FILE *fp);
+
+static inline uint64_t
+trace_now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+#ifdef NO_TRACE
+#define TRACE_PARSED(s) ((void)0)
+#define TRACE_EVENT(s, event, from) ((void)(from))
+#define TRACE_FRUIT(s, nvarieties) ((void)0)
+#else
+/* An event was parsed in the current state. */
+#define TRACE_PARSED(s) \
+    do { if (__builtin_expect((s)->trace != NULL, 0)) trace_parsed((s)->trace, (s)->state); } while (0)
+/* An event was handled, moving from a state to the current one. */
+#define TRACE_EVENT(s, event, from) \
+    do { if (__builtin_expect((s)->trace != NULL, 0)) trace_event((s)->trace, event, from, (s)->state); } while (0)
+/* A fruit was completed. */
+#define TRACE_FRUIT(s, nvarieties) \
+    do { if (__builtin_expect((s)->trace != NULL, 0)) trace_fruit((s)->trace, nvarieties); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,230 @@
+/*
+ * Fast yaml writer for fruit catalogs.
+ *
+ * The libyaml emitter analyzes every scalar and goes through its state
+ * machine for every event, which dominates the time to emit a large catalog.
+ * Since the schema is fixed, the block yaml for it can be written directly:
+ * the keys and indentation are constant fragments, and only the values need
+ * to be copied into the output buffer (output.c).
+ *
+ * The output is byte for byte the same as the output of the libyaml emitter
+ * in emit.c, for catalogs where all the strings can be written as plain
+ * scalars without line folding.  writer_supports() checks this, and emit
+ * uses the libyaml emitter for catalogs which fail the check.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "writer.h"
+
+/* The libyaml emitter folds plain scalars with spaces after this column. */
+#define BEST_WIDTH 80
+
+/* Key fragments, and the column where their values start. */
+#define FRUIT_NAME        "- name: "
+#define FRUIT_COLOR       "  color: "
+#define FRUIT_COUNT       "  count: "
+#define FRUIT_VARIETIES   "  varieties:\n"
+#define VARIETY_NAME      "  - name: "
+#define VARIETY_COLOR     "    color: "
+#define VARIETY_SEEDLESS  "    seedless: "
+
+#define COLUMN(key) (sizeof(key) - 1)
+
+#define write_key(out, key) output_put(out, key, sizeof(key) - 1)
+
+/* Write a string value and the end of its line. */
+static inline void
+write_string(struct output *out, const char *s)
+{
+    size_t length = strlen(s);
+
+    if (out->used + length + 1 <= out->size) {
+        memcpy(out->buffer + out->used, s, length);
+        out->buffer[out->used + length] = '\n';
+        out->used += length + 1;
+    } else {
+        output_write(out, s, length);
+        output_write(out, "\n", 1);
+    }
+}
+
+/* Format an integer value and the end of its line at the end of digits. */
+static inline char *
+format_integer(char *end, int64_t value)
+{
+    char *p = end;
+    uint64_t n = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+    *--p = '\n';
+    do {
+        *--p = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    if (value < 0) {
+        *--p = '-';
+    }
+    return p;
+}
+
+/* Write an integer value and the end of its line. */
+static inline void
+write_integer(struct output *out, int64_t value)
+{
+    char digits[24];
+    char *p = format_integer(digits + sizeof(digits), value);
+
+    output_put(out, p, digits + sizeof(digits) - p);
+}
+
+/* Check if a character is a space or the end of the string. */
+static inline int
+is_blank_or_end(char c)
+{
+    return c == ' ' || c == '\0';
+}
+
+/*
+ * Check if the libyaml emitter would write a value starting at a column
+ * as a plain scalar on one line.  This follows yaml_emitter_analyze_scalar(),
+ * conservatively: strings it is unsure of are rejected.
+ */
+static int
+is_plain(const char *s, size_t column)
+{
+    size_t length = strlen(s);
+    int space = 0;
+
+    if (length == 0 || s[0] == ' ' || s[length - 1] == ' ') {
+        return 0;
+    }
+    if (length >= 3 && (strncmp(s, "---", 3) == 0 || strncmp(s, "...", 3) == 0)) {
+        return 0;
+    }
+    if (strchr("#,[]{}&*!|>'\"%@`", s[0])) {
+        return 0;
+    }
+    if ((s[0] == '?' || s[0] == ':' || s[0] == '-') && is_blank_or_end(s[1])) {
+        return 0;
+    }
+    for (const char *p = s; *p; p++) {
+        unsigned char c = *p;
+
+        /* Only printable ascii; anything else is quoted or escaped. */
+        if (c < 0x20 || c > 0x7e) {
+            return 0;
+        }
+        if (p > s && strchr(",?[]{}", c)) {
+            return 0;
+        }
+        if (c == ':' && (p > s || is_blank_or_end(p[1]))) {
+            return 0;
+        }
+        if (c == '#' && p[-1] == ' ') {
+            return 0;
+        }
+        if (c == ' ') {
+            space = 1;
+        }
+    }
+    /* Long values with spaces may be folded onto several lines. */
+    if (space && column + length > BEST_WIDTH) {
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Check if the catalog can be written by write_catalog().
+ */
+int
+writer_supports(const struct catalog *c)
+{
+    for (size_t i = 0; i < c->nfruits; i++) {
+        const struct catalog_fruit *f = &c->fruits[i];
+        const struct catalog_variety *v = catalog_varieties(c, f);
+
+        if (!is_plain(f->name, COLUMN(FRUIT_NAME)) ||
+            !is_plain(f->color, COLUMN(FRUIT_COLOR))) {
+            return 0;
+        }
+        for (size_t j = 0; j < f->nvarieties; j++, v++) {
+            if (!is_plain(v->name, COLUMN(VARIETY_NAME)) ||
+                !is_plain(v->color, COLUMN(VARIETY_COLOR))) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/*
+ * Get the exact size of the output of write_catalog(), so space for it can be
+ * allocated up front.
+ */
+size_t
+writer_size(const struct catalog *c)
+{
+    size_t size = c->nfruits ? sizeof("---\nfruit:\n...\n") - 1 : sizeof("---\nfruit: []\n...\n") - 1;
+    char digits[24];
+
+    for (size_t i = 0; i < c->nfruits; i++) {
+        const struct catalog_fruit *f = &c->fruits[i];
+        const struct catalog_variety *v = catalog_varieties(c, f);
+
+        size += COLUMN(FRUIT_NAME) + strlen(f->name) + 1;
+        size += COLUMN(FRUIT_COLOR) + strlen(f->color) + 1;
+        size += COLUMN(FRUIT_COUNT) + (digits + sizeof(digits) - format_integer(digits + sizeof(digits), f->count));
+        if (f->nvarieties > 0) {
+            size += COLUMN(FRUIT_VARIETIES);
+        }
+        for (size_t j = 0; j < f->nvarieties; j++, v++) {
+            size += COLUMN(VARIETY_NAME) + strlen(v->name) + 1;
+            size += COLUMN(VARIETY_COLOR) + strlen(v->color) + 1;
+            size += COLUMN(VARIETY_SEEDLESS) + (v->seedless ? sizeof("true\n") : sizeof("false\n")) - 1;
+        }
+    }
+    return size;
+}
+
+/*
+ * Write a catalog as a yaml stream.  The catalog must have passed
+ * writer_supports().  Returns 0 on success or an errno value.
+ */
+int
+write_catalog(const struct catalog *c, struct output *out)
+{
+    if (c->nfruits == 0) {
+        write_key(out, "---\nfruit: []\n");
+    } else {
+        write_key(out, "---\nfruit:\n");
+    }
+    for (size_t i = 0; i < c->nfruits; i++) {
+        const struct catalog_fruit *f = &c->fruits[i];
+        const struct catalog_variety *v = catalog_varieties(c, f);
+
+        write_key(out, FRUIT_NAME);
+        write_string(out, f->name);
+        write_key(out, FRUIT_COLOR);
+        write_string(out, f->color);
+        write_key(out, FRUIT_COUNT);
+        write_integer(out, f->count);
+        if (f->nvarieties > 0) {
+            write_key(out, FRUIT_VARIETIES);
+        }
+        for (size_t j = 0; j < f->nvarieties; j++, v++) {
+            write_key(out, VARIETY_NAME);
+            write_string(out, v->name);
+            write_key(out, VARIETY_COLOR);
+            write_string(out, v->color);
+            if (v->seedless) {
+                write_key(out, VARIETY_SEEDLESS "true\n");
+            } else {
+                write_key(out, VARIETY_SEEDLESS "false\n");
+            }
+        }
+    }
+    write_key(out, "...\n");
+    return out->error;
+}
@@ -0,0 +1,17 @@
+/*
+ * Fast yaml writer for fruit catalogs.
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+
+#include "fruit.h"
+#include "output.h"
+
+int writer_supports(const struct catalog *c);
+size_t writer_size(const struct catalog *c);
+int write_catalog(const struct catalog *c, struct output *out);
+
+#endif
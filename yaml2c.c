@@ -0,0 +1,181 @@
+/*
+ * Compile a fruit catalog into C data.
+ *
+ * Loads a yaml file with the parser of parse.c and writes a C source file
+ * which defines the catalog as const snapshot records (snapshot.h): the
+ * fruits, the varieties, and one pool of strings, each string stored once.
+ * The records refer to the strings by offset rather than by pointer, so
+ * they need no relocations and stay in read-only pages shared by every
+ * process running the program.  Only the struct snapshot which describes
+ * them holds pointers.  A program which links the generated file has the
+ * catalog without parsing anything at startup:
+ *
+ *    $ ./yaml2c --name fruit_data --output fruit-data.c fruit.yaml
+ *
+ *    extern const struct snapshot fruit_data;
+ *
+ * The Makefile regenerates fruit-data.c whenever fruit.yaml changes; see
+ * builtin.c.
+ */
+#include <yaml.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "input.h"
+#include "load.h"
+#include "snapshot.h"
+
+void
+usage(void)
+{
+    fprintf(stderr, "usage: yaml2c [--name NAME] [--output FILE] input.yaml\n");
+    exit(EXIT_FAILURE);
+}
+
+/* Write a string as a C string literal. */
+void
+write_literal(FILE *fp, const char *s)
+{
+    putc('"', fp);
+    for (; *s; s++) {
+        unsigned char c = *s;
+
+        if (c == '"' || c == '\\' || c == '?') {
+            /* '?' is escaped so no trigraph can form. */
+            fprintf(fp, "\\%c", c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            fprintf(fp, "\\%03o", c);
+        } else {
+            putc(c, fp);
+        }
+    }
+    fputs("\\0\"", fp);
+}
+
+/*
+ * Write the C source for a snapshot image.
+ */
+void
+write_source(FILE *fp, const struct snapshot_image *image, const char *name, const char *path)
+{
+    fprintf(fp, "/* Generated by yaml2c from %s.  Do not edit. */\n\n", path);
+    fprintf(fp, "#include \"snapshot.h\"\n\n");
+
+    fprintf(fp, "static const char %s_strings[] =", name);
+    for (size_t offset = 0; offset < image->strings_size; offset += strlen(image->strings + offset) + 1) {
+        fprintf(fp, "\n    ");
+        write_literal(fp, image->strings + offset);
+    }
+    fprintf(fp, "%s;\n\n", image->strings_size ? "" : " \"\"");
+
+    /* Arrays may not be empty, so each has at least one record. */
+    fprintf(fp, "static const struct snapshot_variety %s_varieties[] = {\n", name);
+    for (size_t i = 0; i < image->nvarieties; i++) {
+        const struct snapshot_variety *v = &image->varieties[i];
+
+        fprintf(fp, "    {%" PRIu64 ", %" PRIu64 ", %" PRIu64 "},\n", v->name, v->color, v->seedless);
+    }
+    fprintf(fp, "%s};\n\n", image->nvarieties ? "" : "    {0, 0, 0},\n");
+
+    fprintf(fp, "static const struct snapshot_fruit %s_fruits[] = {\n", name);
+    for (size_t i = 0; i < image->nfruits; i++) {
+        const struct snapshot_fruit *f = &image->fruits[i];
+
+        fprintf(fp, "    {%" PRIu64 ", %" PRIu64 ", ", f->name, f->color);
+        if (f->count == INT64_MIN) {
+            /* -9223372036854775808 would be minus an out of range constant. */
+            fprintf(fp, "INT64_MIN");
+        } else {
+            fprintf(fp, "INT64_C(%" PRId64 ")", f->count);
+        }
+        fprintf(fp, ", %" PRIu64 ", %" PRIu64 "},\n", f->variety, f->nvarieties);
+    }
+    fprintf(fp, "%s};\n\n", image->nfruits ? "" : "    {0, 0, 0, 0, 0},\n");
+
+    fprintf(fp, "const struct snapshot %s = {\n", name);
+    fprintf(fp, "    .fruits = %s_fruits,\n", name);
+    fprintf(fp, "    .nfruits = %zu,\n", image->nfruits);
+    fprintf(fp, "    .varieties = %s_varieties,\n", name);
+    fprintf(fp, "    .nvarieties = %zu,\n", image->nvarieties);
+    fprintf(fp, "    .strings = %s_strings,\n", name);
+    fprintf(fp, "};\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *name = "fruit_data";
+    const char *output = NULL;
+    const char *path;
+    struct parser_state state;
+    struct snapshot_image image;
+    yaml_parser_t parser;
+    struct input input;
+    FILE *fp = stdout;
+    int code = EXIT_FAILURE;
+    int error;
+    struct option options[] = {
+        {"name", required_argument, NULL, 'n'},
+        {"output", required_argument, NULL, 'o'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "n:o:", options, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            name = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+    }
+    path = argv[optind];
+
+    if ((error = input_map(&input, path))) {
+        fprintf(stderr, "%s: %s\n", path, strerror(error));
+        return EXIT_FAILURE;
+    }
+    parser_state_init(&state, NULL, NULL);
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, input.data, input.size);
+    if (load_events(&state, &parser) == FAILURE) {
+        goto done;
+    }
+    snapshot_build(&image, &state.catalog);
+    if (output && !(fp = fopen(output, "w"))) {
+        perror(output);
+        snapshot_image_destroy(&image);
+        goto done;
+    }
+    write_source(fp, &image, name, path);
+    snapshot_image_destroy(&image);
+    if (fflush(fp) == 0 && !ferror(fp)) {
+        code = EXIT_SUCCESS;
+    } else {
+        perror(output ? output : "stdout");
+    }
+    if (output) {
+        fclose(fp);
+        if (code == EXIT_FAILURE) {
+            /* Do not leave a partial file for make to use. */
+            remove(output);
+        }
+    }
+
+done:
+    yaml_parser_delete(&parser);
+    parser_state_destroy(&state);
+    input_close(&input);
+    return code;
+}